@@ -0,0 +1,643 @@
+/*
+ * json_bench.cpp
+ *
+ * Measures parsing, lookup and serialization throughput on generated corpora
+ *
+ * usage: json_bench [--json results.json] [--compare old.json]
+ *                   [--time seconds] [--filter text]
+ *
+ * The corpora are generated deterministically so results from different
+ * commits can be compared with --compare.
+ */
+
+#include "json/json.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <utility>
+
+namespace {
+
+struct Corpus {
+    std::string name;
+    std::string text;
+    bool lines = false; // Newline delimited json
+};
+
+struct Result {
+    std::string corpus;
+    std::string operation;
+    double mbPerSecond = 0; // Zero when the operation does not read the text
+    double nsPerNode = 0;
+    size_t memory = 0; // Bytes allocated by the result, zero if not measured
+};
+
+//! Simple random generator that gives the same sequence on all platforms
+struct Random {
+    uint64_t state = 1;
+
+    uint64_t operator()(uint64_t max) {
+        state = state * 6364136223846793005u + 1442695040888963407u;
+        return (state >> 33) % max;
+    }
+};
+
+//! Create a document with a mix of objects, strings and numbers
+std::string createDocument(size_t records) {
+    auto json = Json{Json::Array};
+    json.reserve(records);
+    for (size_t i = 0; i < records; ++i) {
+        auto record = Json{Json::Object};
+        record["id"] = Json{i};
+        record["name"] = "record number " + std::to_string(i);
+        record["message"] = "the quick brown fox jumps over the lazy dog, "
+                            "\"quoted\"\tand escaped\\n";
+        record["values"].vector({"first", "second", "third"});
+        record["flag"] = Json::Parse(i % 2 ? "true" : "false");
+        json.push_back(record);
+    }
+    return json.stringify(2);
+}
+
+//! The records in createDocument() as a struct
+struct Record {
+    size_t id = 0;
+    std::string name;
+    std::string message;
+    std::vector<std::string> values;
+    bool flag = false;
+};
+
+JSON_FIELDS(Record, id, name, message, values, flag)
+
+//! Create arrays of objects nested deeply
+std::string createDeepDocument(size_t count, size_t depth) {
+    auto text = std::string{"["};
+    for (size_t i = 0; i < count; ++i) {
+        if (i) {
+            text += ",";
+        }
+        for (size_t d = 0; d < depth; ++d) {
+            text += R"({"level": )" + std::to_string(d) + R"(, "next": [)";
+        }
+        text += "null";
+        for (size_t d = 0; d < depth; ++d) {
+            text += "]}";
+        }
+    }
+    return text + "]";
+}
+
+//! Create one object with many keys
+std::string createWideDocument(size_t width) {
+    auto json = Json{Json::Object};
+    json.reserve(width);
+    for (size_t i = 0; i < width; ++i) {
+        json.push_back(Json{i});
+        json.back().name = "key" + std::to_string(i);
+    }
+    return json.stringify(2);
+}
+
+//! Create a array of numbers like telemetry data
+std::string createNumberDocument(size_t count) {
+    auto json = Json{Json::Array};
+    json.reserve(count);
+    auto random = Random{};
+    for (size_t i = 0; i < count; ++i) {
+        if (i % 3) {
+            json.emplace_back(static_cast<double>(random(1000000)) / 1000);
+        }
+        else {
+            json.emplace_back(random(1000000000));
+        }
+    }
+    return json.stringify(Json::compact);
+}
+
+//! Create log entries with long messages
+std::string createLogDocument(size_t count) {
+    const char *levels[] = {"debug", "info", "warning", "error"};
+    const char *words[] = {"request", "handled", "user",     "timeout",
+                           "cache",   "miss",    "database", "connection",
+                           "opened",  "closed",  "retrying", "payload"};
+    auto json = Json{Json::Array};
+    json.reserve(count);
+    auto random = Random{};
+    for (size_t i = 0; i < count; ++i) {
+        auto &entry = json.emplace_back(Json::Object);
+        entry["time"] = "2024-01-01T00:00:" + std::to_string(i % 60) + "Z";
+        entry["level"] = levels[random(4)];
+        auto message = std::string{};
+        for (size_t w = 0, n = 20 + random(200); w < n; ++w) {
+            message += words[random(12)];
+            message += random(20) ? " " : "\n\t";
+        }
+        entry["message"] = message;
+    }
+    return json.stringify(2);
+}
+
+std::vector<Corpus> createCorpora() {
+    auto records = createDocument(20000);
+    auto lines = std::stringstream{};
+    Json::WriteLines(lines, Json::Parse(records));
+
+    return {
+        {"records", records},
+        {"deep", createDeepDocument(200, 200)},
+        {"wide", createWideDocument(100000)},
+        {"numbers", createNumberDocument(200000)},
+        {"logs", createLogDocument(5000)},
+        {"ndjson", lines.str(), true},
+    };
+}
+
+//! Number of values in a Json tree
+size_t countNodes(const Json &json) {
+    size_t count = 1;
+    for (auto &child : json) {
+        count += countNodes(child);
+    }
+    return count;
+}
+
+//! Approximate number of bytes allocated by a Json tree
+size_t memoryUsage(const Json &json) {
+    auto heapSize = [](const std::string &str) {
+        return str.capacity() > 15 ? str.capacity() + 1 : 0;
+    };
+    auto size = json.capacity() * sizeof(Json) + heapSize(json.name) +
+                heapSize(json.value);
+    for (auto &child : json) {
+        size += memoryUsage(child);
+    }
+    return size;
+}
+
+//! Look up all members of all objects by name
+size_t lookupAll(const Json &json) {
+    size_t count = 0;
+    if (json.type == Json::Object) {
+        for (auto &child : json) {
+            count += &json[child.name] == &child;
+        }
+    }
+    for (auto &child : json) {
+        count += lookupAll(child);
+    }
+    return count;
+}
+
+//! Run function until at least some time has passed
+//! @return seconds per call
+template <typename F>
+double measure(double minTime, F f) {
+    using namespace std::chrono;
+    auto start = steady_clock::now();
+    size_t iterations = 0;
+    auto elapsed = duration<double>{};
+    // Counts are kept so that calls without side effects are not removed
+    static volatile size_t kept = 0;
+    do {
+        if constexpr (std::is_same_v<decltype(f()), size_t>) {
+            kept = f();
+        }
+        else {
+            f();
+        }
+        ++iterations;
+        elapsed = steady_clock::now() - start;
+    } while (elapsed.count() < minTime);
+
+    return elapsed.count() / static_cast<double>(iterations);
+}
+
+class Suite {
+public:
+    double minTime = .5;
+    std::string filter;
+    std::vector<Result> results;
+
+    //! Run f if the name matches the filter and save the result
+    //! @param bytes size of the text that is read or written
+    //! @param nodes number of values that are handled
+    template <typename F>
+    void run(const Corpus &corpus,
+             const std::string &operation,
+             size_t bytes,
+             size_t nodes,
+             F f,
+             size_t memory = 0) {
+        if ((corpus.name + " " + operation).find(filter) == std::string::npos) {
+            return;
+        }
+        auto seconds = measure(minTime, f);
+        auto result = Result{corpus.name, operation};
+        result.mbPerSecond = bytes ? static_cast<double>(bytes) / seconds / 1e6
+                                   : 0;
+        result.nsPerNode = seconds * 1e9 / static_cast<double>(nodes);
+        result.memory = memory;
+        print(result);
+        results.push_back(result);
+    }
+
+    static void print(const Result &result) {
+        std::cout << std::left << std::setw(10) << result.corpus
+                  << std::setw(20) << result.operation << std::right
+                  << std::fixed << std::setprecision(1) << std::setw(10)
+                  << result.mbPerSecond << std::setw(10) << result.nsPerNode;
+        if (result.memory) {
+            std::cout << std::setw(12) << result.memory / 1000;
+        }
+        std::cout << std::endl;
+    }
+
+    Json toJson() const {
+        auto json = Json{Json::Array};
+        for (auto &result : results) {
+            auto &entry = json.emplace_back(Json::Object);
+            entry["corpus"] = result.corpus;
+            entry["operation"] = result.operation;
+            entry["mb_per_s"].number(result.mbPerSecond);
+            entry["ns_per_node"].number(result.nsPerNode);
+            if (result.memory) {
+                entry["memory_bytes"].number(result.memory);
+            }
+        }
+        return json;
+    }
+
+    //! Print the change in time per node compared to earlier results
+    void compare(const Json &old) const {
+        std::cout << "\nchange in ns/node compared to earlier run:\n";
+        for (auto &entry : old) {
+            for (auto &result : results) {
+                if (result.corpus != entry["corpus"].string() ||
+                    result.operation != entry["operation"].string()) {
+                    continue;
+                }
+                auto before = entry["ns_per_node"].asDouble();
+                std::cout << std::left << std::setw(10) << result.corpus
+                          << std::setw(20) << result.operation << std::right
+                          << std::showpos << std::setw(9)
+                          << (result.nsPerNode / before - 1) * 100
+                          << std::noshowpos << " %\n";
+            }
+        }
+    }
+};
+
+//! Operations for newline delimited json
+void runLines(Suite &suite, const Corpus &corpus) {
+    auto &text = corpus.text;
+    auto values = std::vector<Json>{};
+    size_t nodes = 0;
+    auto input = std::istringstream{text};
+    Json::LineReader{input}.forEach([&](Json &json) {
+        nodes += countNodes(json);
+        values.push_back(json);
+    });
+
+    suite.run(corpus, "read lines", text.size(), nodes, [&] {
+        auto input = std::istringstream{text};
+        Json::LineReader{input}.forEach([](Json &) {});
+    });
+
+    // What had to be done without a line reader
+    suite.run(corpus, "getline and parse", text.size(), nodes, [&] {
+        auto input = std::istringstream{text};
+        for (std::string line; std::getline(input, line);) {
+            auto lineStream = std::istringstream{line};
+            Json::Parse(lineStream);
+        }
+    });
+
+    suite.run(corpus, "write lines", text.size(), nodes, [&] {
+        auto out = std::ostringstream{};
+        Json::WriteLines(out, values);
+    });
+}
+
+void runCorpus(Suite &suite, const Corpus &corpus) {
+    if (corpus.lines) {
+        runLines(suite, corpus);
+        return;
+    }
+
+    auto &text = corpus.text;
+    auto size = text.size();
+    auto json = Json::Parse(text);
+    auto nodes = countNodes(json);
+
+    suite.run(
+        corpus,
+        "parse",
+        size,
+        nodes,
+        [&] { Json::Parse(text); },
+        sizeof(Json) + memoryUsage(json));
+
+    auto noPositions = Json::ParseOptions{};
+    noPositions.positions = false;
+    suite.run(corpus, "parse no positions", size, nodes, [&] {
+        return Json::Parse(text, noPositions).size();
+    });
+
+    suite.run(corpus, "parse istream", size, nodes, [&] {
+        auto ss = std::istringstream{text};
+        Json::Parse(ss);
+    });
+
+    // Input that arrives in parts, like from a socket
+    suite.run(corpus, "parse incremental", size, nodes, [&] {
+        auto parser = Json::IncrementalParser{};
+        for (size_t i = 0; i < size; i += 4096) {
+            parser.feed(text.data() + i, std::min<size_t>(4096, size - i));
+        }
+        parser.finish();
+        return parser.take().size();
+    });
+
+    struct Counter : public Json::EventHandler {
+        size_t strings = 0;
+        bool onString(std::string_view) {
+            ++strings;
+            return true;
+        }
+    };
+    suite.run(corpus, "parse events", size, nodes, [&] {
+        auto counter = Counter{};
+        Json::ParseEvents(text, counter);
+    });
+
+    suite.run(
+        corpus,
+        "parse document",
+        size,
+        nodes,
+        [&] { Json::Document::Parse(text); },
+        Json::Document::Parse(text).memoryUsage());
+
+    suite.run(corpus, "validate", size, nodes, [&] {
+        return static_cast<size_t>(!Json::Validate(text));
+    });
+
+    auto interning = Json::ParseOptions{};
+    interning.internNames = true;
+    suite.run(
+        corpus,
+        "parse interned",
+        size,
+        nodes,
+        [&] { Json::Document::Parse(text, interning); },
+        Json::Document::Parse(text, interning).memoryUsage());
+
+    if (corpus.name == "records") {
+        // One of the last members of each record
+        auto findAll = [](const Json::Document &document) {
+            size_t found = 0;
+            for (auto record : document) {
+                found += record.find("values") != record.end();
+            }
+            return found;
+        };
+        auto plain = Json::Document::Parse(text);
+        auto interned = Json::Document::Parse(text, interning);
+        suite.run(corpus, "doc lookup", 0, findAll(plain), [&] {
+            return findAll(plain);
+        });
+        suite.run(corpus, "doc lookup interned", 0, findAll(plain), [&] {
+            return findAll(interned);
+        });
+    }
+
+    // Skip to the last value without parsing the rest
+    suite.run(corpus, "lazy last value", size, nodes, [&] {
+        auto lazy = Json::ParseLazy(text);
+        auto last = std::string_view{};
+        for (auto &child : lazy) {
+            last = child.raw();
+        }
+        return last;
+    });
+
+    if (corpus.name == "records") {
+        auto records = Json::ParseInto<std::vector<Record>>(text);
+        suite.run(corpus, "parse into", size, nodes, [&] {
+            return Json::ParseInto<std::vector<Record>>(text).size();
+        });
+        suite.run(corpus, "serialize", size, nodes, [&] {
+            return Json::Serialize(records, 2).size();
+        });
+
+        // The same values are extracted from many documents
+        auto paths = Json::PathSet{};
+        for (auto index : {"/0", "/100", "/1000", "/10000"}) {
+            paths.add(Json::Path{std::string{index} + "/name"});
+            paths.add(Json::Path{std::string{index} + "/values/2"});
+        }
+        suite.run(corpus, "path set", 0, paths.size(), [&] {
+            return paths.find(json).size();
+        });
+        suite.run(corpus, "path set scan", size, nodes, [&] {
+            return paths.scan(text).size();
+        });
+    }
+
+    const auto fname = "json_bench_" + corpus.name + ".json";
+    json.saveFile(fname);
+    auto fileSize = Json::readFile(fname).size();
+
+    suite.run(corpus, "load file", fileSize, nodes, [&] {
+        Json::LoadFile(fname);
+    });
+
+    suite.run(
+        corpus,
+        "map file",
+        fileSize,
+        nodes,
+        [&] { Json::Document::MapFile(fname); },
+        Json::Document::MapFile(fname).memoryUsage());
+
+    suite.run(corpus, "save file", fileSize, nodes, [&] {
+        json.saveFile(fname);
+    });
+    std::remove(fname.c_str());
+
+    // Binary snapshot of the same tree
+    const auto binaryName = "json_bench_" + corpus.name + ".cbor";
+    json.saveBinary(binaryName);
+    auto binarySize = Json::readFile(binaryName).size();
+
+    suite.run(corpus, "save binary", binarySize, nodes, [&] {
+        json.saveBinary(binaryName);
+    });
+
+    suite.run(corpus, "load binary", binarySize, nodes, [&] {
+        Json::LoadBinary(binaryName);
+    });
+    std::remove(binaryName.c_str());
+
+    suite.run(
+        corpus,
+        "copy",
+        0,
+        nodes,
+        [&] {
+            auto copy = json;
+            return copy.size();
+        },
+        memoryUsage(json));
+
+    auto shared = Json::Shared{json};
+    suite.run(corpus, "copy shared", 0, nodes, [&] {
+        auto copy = shared;
+        return copy->size();
+    });
+
+    auto lookups = lookupAll(json);
+    if (lookups) {
+        suite.run(corpus, "lookup", 0, lookups, [&] { lookupAll(json); });
+    }
+
+    if (corpus.name == "wide") {
+        // Indexed lookup of a member that is known when compiling
+        suite.run(corpus, "index lookup", 0, 1, [&] {
+            return static_cast<size_t>(json["key500"].asInt64());
+        });
+        suite.run(corpus, "index lookup key", 0, 1, [&] {
+            return static_cast<size_t>(json["key500"_jk].asInt64());
+        });
+    }
+
+    if (corpus.name == "records") {
+        // Optional member that none of the records have
+        suite.run(corpus, "missing key throw", 0, json.size(), [&] {
+            size_t found = 0;
+            for (const auto &record : json) {
+                try {
+                    found += record["optional"].type != Json::None;
+                }
+                catch (std::out_of_range &) {
+                }
+            }
+            return found;
+        });
+        // Member that is known when compiling
+        suite.run(corpus, "field lookup", 0, json.size(), [&] {
+            size_t found = 0;
+            for (const auto &record : json) {
+                found += record["values"].type == Json::Array;
+            }
+            return found;
+        });
+        suite.run(corpus, "field lookup key", 0, json.size(), [&] {
+            size_t found = 0;
+            for (const auto &record : json) {
+                found += record["values"_jk].type == Json::Array;
+            }
+            return found;
+        });
+        suite.run(corpus, "missing key tryGet", 0, json.size(), [&] {
+            size_t found = 0;
+            for (const auto &record : json) {
+                found += record.tryGet("optional") != nullptr;
+            }
+            return found;
+        });
+    }
+
+    // Snapshots that only differ in a few places
+    auto changed = json;
+    if (changed.size() > 100) {
+        changed.vector().erase(changed.begin() + 10);
+        changed.vector().insert(changed.begin() + 50, Json{"inserted"});
+        changed[90] = Json{"replaced"};
+    }
+    auto same = json;
+    suite.run(corpus, "equal", 0, nodes, [&] {
+        return static_cast<size_t>(json == same);
+    });
+    suite.run(corpus, "hash", 0, nodes, [&] {
+        return static_cast<size_t>(json.hash());
+    });
+    suite.run(corpus, "diff", 0, nodes, [&] {
+        return Json::Diff(json, changed).size();
+    });
+
+    suite.run(corpus, "stringify", json.stringifiedSize(2), nodes, [&] {
+        json.stringify(2);
+    });
+
+    auto out = std::string{};
+    suite.run(corpus,
+              "stringify compact",
+              json.stringifiedSize(Json::compact),
+              nodes,
+              [&] {
+                  out.clear();
+                  json.stringify(out, Json::compact);
+              });
+
+    suite.run(corpus, "stringify parallel", json.stringifiedSize(2), nodes, [&] {
+        json.stringify(2, Json::StringifyOptions{});
+    });
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    auto suite = Suite{};
+    auto jsonOutput = std::string{};
+    auto compareWith = std::string{};
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        auto arg = std::string{argv[i]};
+        if (arg == "--json") {
+            jsonOutput = argv[i + 1];
+        }
+        else if (arg == "--compare") {
+            compareWith = argv[i + 1];
+        }
+        else if (arg == "--time") {
+            suite.minTime = std::stod(argv[i + 1]);
+        }
+        else if (arg == "--filter") {
+            suite.filter = argv[i + 1];
+        }
+        else {
+            std::cerr << "unknown argument " << arg << "\n";
+            return 1;
+        }
+    }
+
+    auto corpora = createCorpora();
+
+    std::cout << "threads: " << std::thread::hardware_concurrency() << "\n";
+    for (auto &corpus : corpora) {
+        std::cout << corpus.name << ": " << corpus.text.size() / 1000
+                  << " kB\n";
+    }
+    std::cout << "\n"
+              << std::left << std::setw(30) << "corpus    operation"
+              << std::right << std::setw(10) << "MB/s" << std::setw(10)
+              << "ns/node" << std::setw(12) << "memory kB" << "\n";
+
+    for (auto &corpus : corpora) {
+        runCorpus(suite, corpus);
+    }
+
+    if (!jsonOutput.empty()) {
+        suite.toJson().saveFile(jsonOutput);
+    }
+    if (!compareWith.empty()) {
+        suite.compare(Json::LoadFile(compareWith));
+    }
+
+    return 0;
+}
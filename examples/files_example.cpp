@@ -21,7 +21,7 @@ int main(int, char *[]) {
 
         // Print all elements in sub.array
         for (auto &j : json["sub"]["array"]) {
-            std::cout << "array element: " << j.value << "\n";
+            std::cout << "array element: " << j.asInt64() << "\n";
         }
     }
 
@@ -7,12 +7,179 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <exception>
 #include <fstream>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
+// Errors are reported with exceptions. When compiled with -fno-exceptions
+// they call std::abort() instead, use the functions that returns errors, like
+// Json::tryParse, Json::tryGet and Json::getIf, to handle them
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+#define JSON_THROW(exception) throw exception
+#define JSON_TRY try
+#define JSON_CATCH(Type, name) catch (Type &name)
+#define JSON_CATCH_ALL catch (...)
+#else
+#define JSON_THROW(exception) (static_cast<void>(exception), std::abort())
+#define JSON_TRY if (true)
+// The handler is compiled but never run
+#define JSON_CATCH(Type, name) else for (Type &name : std::array<Type, 0>{})
+#define JSON_CATCH_ALL else
+#endif
+
+// Objects with at least this many children gets a hash index for lookups
+#ifndef JSON_KEY_INDEX_THRESHOLD
+#define JSON_KEY_INDEX_THRESHOLD 16
+#endif
+
+//! Describe the members of a struct for Json::ParseInto and Json::Serialize
+//! Use in the same namespace as the struct, at most 32 members
+//!
+//! struct Point { int x; int y; };
+//! JSON_FIELDS(Point, x, y)
+#define JSON_FIELDS(Type, ...)                                                 \
+    constexpr auto jsonFields(const Type *) {                                  \
+        using JsonFieldsType = Type;                                           \
+        return std::make_tuple(JSON_FOR_EACH(JSON_FIELD, __VA_ARGS__));        \
+    }
+
+#define JSON_FIELD(member) Json::field(#member, &JsonFieldsType::member)
+
+// Apply m to each argument, separated by comma
+#define JSON_EXPAND(x) x
+#define JSON_FOR_EACH_1(m, x) m(x)
+#define JSON_FOR_EACH_2(m, x, ...)                                             \
+    m(x), JSON_EXPAND(JSON_FOR_EACH_1(m, __VA_ARGS__))
+#define JSON_FOR_EACH_3(m, x, ...)                                             \
+    m(x), JSON_EXPAND(JSON_FOR_EACH_2(m, __VA_ARGS__))
+#define JSON_FOR_EACH_4(m, x, ...)                                             \
+    m(x), JSON_EXPAND(JSON_FOR_EACH_3(m, __VA_ARGS__))
+#define JSON_FOR_EACH_5(m, x, ...)                                             \
+    m(x), JSON_EXPAND(JSON_FOR_EACH_4(m, __VA_ARGS__))
+#define JSON_FOR_EACH_6(m, x, ...)                                             \
+    m(x), JSON_EXPAND(JSON_FOR_EACH_5(m, __VA_ARGS__))
+#define JSON_FOR_EACH_7(m, x, ...)                                             \
+    m(x), JSON_EXPAND(JSON_FOR_EACH_6(m, __VA_ARGS__))
+#define JSON_FOR_EACH_8(m, x, ...)                                             \
+    m(x), JSON_EXPAND(JSON_FOR_EACH_7(m, __VA_ARGS__))
+#define JSON_FOR_EACH_9(m, x, ...)                                             \
+    m(x), JSON_EXPAND(JSON_FOR_EACH_8(m, __VA_ARGS__))
+#define JSON_FOR_EACH_10(m, x, ...)                                            \
+    m(x), JSON_EXPAND(JSON_FOR_EACH_9(m, __VA_ARGS__))
+#define JSON_FOR_EACH_11(m, x, ...)                                            \
+    m(x), JSON_EXPAND(JSON_FOR_EACH_10(m, __VA_ARGS__))
+#define JSON_FOR_EACH_12(m, x, ...)                                            \
+    m(x), JSON_EXPAND(JSON_FOR_EACH_11(m, __VA_ARGS__))
+#define JSON_FOR_EACH_13(m, x, ...)                                            \
+    m(x), JSON_EXPAND(JSON_FOR_EACH_12(m, __VA_ARGS__))
+#define JSON_FOR_EACH_14(m, x, ...)                                            \
+    m(x), JSON_EXPAND(JSON_FOR_EACH_13(m, __VA_ARGS__))
+#define JSON_FOR_EACH_15(m, x, ...)                                            \
+    m(x), JSON_EXPAND(JSON_FOR_EACH_14(m, __VA_ARGS__))
+#define JSON_FOR_EACH_16(m, x, ...)                                            \
+    m(x), JSON_EXPAND(JSON_FOR_EACH_15(m, __VA_ARGS__))
+#define JSON_FOR_EACH_17(m, x, ...)                                            \
+    m(x), JSON_EXPAND(JSON_FOR_EACH_16(m, __VA_ARGS__))
+#define JSON_FOR_EACH_18(m, x, ...)                                            \
+    m(x), JSON_EXPAND(JSON_FOR_EACH_17(m, __VA_ARGS__))
+#define JSON_FOR_EACH_19(m, x, ...)                                            \
+    m(x), JSON_EXPAND(JSON_FOR_EACH_18(m, __VA_ARGS__))
+#define JSON_FOR_EACH_20(m, x, ...)                                            \
+    m(x), JSON_EXPAND(JSON_FOR_EACH_19(m, __VA_ARGS__))
+#define JSON_FOR_EACH_21(m, x, ...)                                            \
+    m(x), JSON_EXPAND(JSON_FOR_EACH_20(m, __VA_ARGS__))
+#define JSON_FOR_EACH_22(m, x, ...)                                            \
+    m(x), JSON_EXPAND(JSON_FOR_EACH_21(m, __VA_ARGS__))
+#define JSON_FOR_EACH_23(m, x, ...)                                            \
+    m(x), JSON_EXPAND(JSON_FOR_EACH_22(m, __VA_ARGS__))
+#define JSON_FOR_EACH_24(m, x, ...)                                            \
+    m(x), JSON_EXPAND(JSON_FOR_EACH_23(m, __VA_ARGS__))
+#define JSON_FOR_EACH_25(m, x, ...)                                            \
+    m(x), JSON_EXPAND(JSON_FOR_EACH_24(m, __VA_ARGS__))
+#define JSON_FOR_EACH_26(m, x, ...)                                            \
+    m(x), JSON_EXPAND(JSON_FOR_EACH_25(m, __VA_ARGS__))
+#define JSON_FOR_EACH_27(m, x, ...)                                            \
+    m(x), JSON_EXPAND(JSON_FOR_EACH_26(m, __VA_ARGS__))
+#define JSON_FOR_EACH_28(m, x, ...)                                            \
+    m(x), JSON_EXPAND(JSON_FOR_EACH_27(m, __VA_ARGS__))
+#define JSON_FOR_EACH_29(m, x, ...)                                            \
+    m(x), JSON_EXPAND(JSON_FOR_EACH_28(m, __VA_ARGS__))
+#define JSON_FOR_EACH_30(m, x, ...)                                            \
+    m(x), JSON_EXPAND(JSON_FOR_EACH_29(m, __VA_ARGS__))
+#define JSON_FOR_EACH_31(m, x, ...)                                            \
+    m(x), JSON_EXPAND(JSON_FOR_EACH_30(m, __VA_ARGS__))
+#define JSON_FOR_EACH_32(m, x, ...)                                            \
+    m(x), JSON_EXPAND(JSON_FOR_EACH_31(m, __VA_ARGS__))
+#define JSON_FOR_EACH_SELECT(                                                  \
+    _1, _2, _3, _4, _5, _6, _7, _8,                                            \
+    _9, _10, _11, _12, _13, _14, _15, _16,                                     \
+    _17, _18, _19, _20, _21, _22, _23, _24,                                    \
+    _25, _26, _27, _28, _29, _30, _31, _32,                                    \
+    name, ...)                                                                 \
+    name
+#define JSON_FOR_EACH(m, ...)                                                  \
+    JSON_EXPAND(JSON_FOR_EACH_SELECT(                                          \
+        __VA_ARGS__,                                                           \
+        JSON_FOR_EACH_32, JSON_FOR_EACH_31, JSON_FOR_EACH_30,                  \
+        JSON_FOR_EACH_29, JSON_FOR_EACH_28, JSON_FOR_EACH_27,                  \
+        JSON_FOR_EACH_26, JSON_FOR_EACH_25, JSON_FOR_EACH_24,                  \
+        JSON_FOR_EACH_23, JSON_FOR_EACH_22, JSON_FOR_EACH_21,                  \
+        JSON_FOR_EACH_20, JSON_FOR_EACH_19, JSON_FOR_EACH_18,                  \
+        JSON_FOR_EACH_17, JSON_FOR_EACH_16, JSON_FOR_EACH_15,                  \
+        JSON_FOR_EACH_14, JSON_FOR_EACH_13, JSON_FOR_EACH_12,                  \
+        JSON_FOR_EACH_11, JSON_FOR_EACH_10, JSON_FOR_EACH_9,                   \
+        JSON_FOR_EACH_8, JSON_FOR_EACH_7, JSON_FOR_EACH_6,                     \
+        JSON_FOR_EACH_5, JSON_FOR_EACH_4, JSON_FOR_EACH_3,                     \
+        JSON_FOR_EACH_2, JSON_FOR_EACH_1)(m,                                   \
+        __VA_ARGS__))
+
+// Files are memory mapped where supported, define JSON_NO_MMAP to always read
+#if !defined(JSON_NO_MMAP) && __has_include(<sys/mman.h>)
+#define JSON_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if !defined(JSON_NO_SIMD) &&                                                  \
+    (defined(__SSE2__) || defined(_M_X64) ||                                   \
+     (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define JSON_SSE2 1
+#include <emmintrin.h>
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+// Avx2 functions are compiled separately and selected at runtime
+#define JSON_AVX2 1
+#include <immintrin.h>
+#endif
+#endif
+
 //! Example usage
 //!
 //! "hello.json":
@@ -38,6 +205,48 @@ public:
         Boolean,
     };
 
+#ifdef JSON_PARSE_STATS
+    struct ParseStats;
+#endif
+
+    //! Settings for parsing
+    struct ParseOptions {
+        //! Nesting of objects and arrays deeper than this is a parsing error
+        size_t maxDepth;
+
+        //! Only for Document: store each distinct member name once, which
+        //! saves memory for arrays of similar objects and lets lookups
+        //! compare names by offset
+        bool internNames;
+
+        //! Reject input that RFC 8259 does not allow but that is accepted
+        //! otherwise: numbers like "01", ".5" and "1.", control characters
+        //! in strings, "\u" without four hex digits, empty input and
+        //! anything but whitespace after the value
+        bool strict;
+
+        //! Set the line and column of each value while parsing. When false,
+        //! parsing from memory skips counting lines and the position is only
+        //! calculated for errors. Values then stay at line 1 column 1.
+        //! Streams always count positions. Document does not store positions
+        //! and never counts them
+        bool positions;
+
+#ifdef JSON_PARSE_STATS
+        //! If set, counters for each parse are written here
+        ParseStats *stats;
+#endif
+
+        // Values are set in the constructor to be usable as default arguments
+        ParseOptions()
+            : maxDepth(1024), internNames(false), strict(false),
+              positions(true) {
+#ifdef JSON_PARSE_STATS
+            stats = nullptr;
+#endif
+        }
+    };
+
     //! Create a json object that is of string type
     //! Note: If you want to parse a json string use "Parse" or "parse"
     Json(std::string str) {
@@ -83,39 +292,128 @@ public:
     ~Json() = default;
 
     //! Create a json object from a file and return the new object
-    static Json LoadFile(std::string fname) {
-        std::ifstream file(fname);
-        return Json::Parse(file);
-    }
+    //! The file is memory mapped and parsed from memory
+    static Json LoadFile(std::string fname, ParseOptions options = {});
 
     //! Load a file to this object
-    Json &loadFile(std::string fname) {
-        std::ifstream{fname} >> *this;
-        return *this;
-    }
+    Json &loadFile(std::string fname, ParseOptions options = {});
 
     //! Save this json object to specified file
     void saveFile(std::string fname) const {
         std::ofstream{fname} << *this;
     }
 
+    //! Settings for stringify on multiple threads
+    struct StringifyOptions {
+        //! Number of threads, 0 for one per hardware thread
+        size_t threads;
+
+        //! Arrays and objects with fewer children are not split between
+        //! threads, so small documents are written on the calling thread
+        size_t threshold;
+
+        // Values are set in the constructor to be usable as default arguments
+        StringifyOptions() : threads(0), threshold(4096) {}
+    };
+
+    //! Same output as stringify(indent), but large arrays and objects are
+    //! split in chunks that are written in parallel
+    std::string stringify(int indent, const StringifyOptions &options) const;
+
+    //! Save to file with the chunks from a parallel stringify written one
+    //! after another without joining them first
+    void saveFile(std::string fname,
+                  int indent,
+                  const StringifyOptions &options) const;
+
+    //! Convert to CBOR (RFC 8949), a binary format that is faster to load
+    //! Numbers are stored without conversion to text and arrays and objects
+    //! begins with the number of children
+    std::string binary() const;
+
+    //! Write CBOR to a stream without creating the whole output first
+    void writeBinary(std::ostream &stream) const;
+
+    void saveBinary(std::string fname) const;
+
+    //! Create a Json object from CBOR
+    //! Tags are ignored and byte strings are not supported
+    //! @throw ParsingError on malformed input, col is the offset in bytes + 1
+    static Json ParseBinary(std::string_view data, ParseOptions options = {});
+
+    //! Read one CBOR value from a stream
+    static Json ParseBinary(std::istream &stream, ParseOptions options = {});
+
+    static Json LoadBinary(std::string fname, ParseOptions options = {});
+
     //! Parse and replace this instance
-    Json &parse(std::string str) {
-        std::istringstream ss(str);
-        parse(ss);
-        return *this;
-    }
+    //! The string is scanned directly from memory without a stream
+    Json &parse(std::string_view str, ParseOptions options = {});
 
-    Json &parse(std::istream &ss);
+    Json &parse(std::istream &ss, ParseOptions options = {});
 
     //! Create a Json object and return the resulting json
-    static Json Parse(std::string string) {
-        return Json{}.parse(std::move(string));
+    static Json Parse(std::string_view string, ParseOptions options = {}) {
+        return std::move(Json{}.parse(string, options));
     }
 
     //! Same as load but on
-    static Json Parse(std::istream &ss) {
-        return Json{}.parse(ss);
+    static Json Parse(std::istream &ss, ParseOptions options = {}) {
+        return std::move(Json{}.parse(ss, options));
+    }
+
+    //! Member of a struct and its name, see JSON_FIELDS
+    template <typename Class, typename Member>
+    struct Field {
+        std::string_view name;
+        Member Class::*member;
+        uint64_t hash;
+    };
+
+    template <typename Class, typename Member>
+    static constexpr Field<Class, Member> field(std::string_view name,
+                                                Member Class::*member) {
+        return {name, member, hashKey(name)};
+    }
+
+    //! Parse directly into a value without building a Json tree
+    //! Supports bool, numbers, std::string, std::vector, std::optional and
+    //! structs described with JSON_FIELDS or a jsonFields() function. Members
+    //! that are missing in the input are left as they are and unknown
+    //! members are skipped.
+    //! @throw ParsingError on malformed input, if types does not match or if
+    //! a number is not integral or out of range for an integer member
+    template <typename T>
+    static T ParseInto(std::string_view str, ParseOptions options = {});
+
+    template <typename T>
+    static T ParseInto(std::istream &stream, ParseOptions options = {});
+
+    //! Write a value supported by ParseInto without building a Json tree
+    //! Empty optional members are left out
+    template <typename T>
+    static std::string Serialize(const T &value, int indent = 4);
+
+    //! Parse without building a tree and report the content to a handler
+    //! Memory usage only depends on the nesting depth of the input
+    //! @return false if the handler stopped parsing
+    //! @throw ParsingError on malformed input
+    template <typename Handler>
+    static bool ParseEvents(std::string_view str,
+                            Handler &handler,
+                            ParseOptions options = {}) {
+        auto input = BufferInput{str.data(), str.data() + str.size()};
+        Position pos;
+        return parseEvents(input, pos, handler, options);
+    }
+
+    template <typename Handler>
+    static bool ParseEvents(std::istream &stream,
+                            Handler &handler,
+                            ParseOptions options = {}) {
+        auto input = StreamInput{stream};
+        Position pos;
+        return parseEvents(input, pos, handler, options);
     }
 
     template <typename T>
@@ -123,22 +421,61 @@ public:
         static_assert("not implemented");
     }
 
+    //! Set content to be a number
     template <typename T>
     Json &number(const T value) {
-        this->value = std::to_string(value);
+        static_assert(std::is_arithmetic_v<T>, "number must be arithmetic");
+        this->value.clear();
         type = Number;
+        numberValue = NumberValue{value};
         return *this;
     }
 
+    //! Get the numeric value converted to double
+    //! @throw std::runtime_error if not of type Number
+    double asDouble() const {
+        return numberOrThrow().as<double>();
+    }
+
+    //! Get the numeric value converted to a signed integer
+    //! Floating point values are truncated and values out of range clamped
+    //! @throw std::runtime_error if not of type Number
+    int64_t asInt64() const {
+        return numberOrThrow().as<int64_t>();
+    }
+
+    //! Same as above but unsigned
+    uint64_t asUInt64() const {
+        return numberOrThrow().as<uint64_t>();
+    }
+
     //! Get child by index
     //! Notice that this is not relevant for type Object
+    //! The key index is rebuilt on next lookup since the child can be renamed
     Json &operator[](int index) {
-        return vector()[index];
+        keyIndex.reset();
+        return std::vector<Json>::operator[](index);
+    }
+
+    const Json &operator[](int index) const {
+        return std::vector<Json>::operator[](index);
     }
 
+    //! Name of a child with the hash calculated in advance, at compile time
+    //! when created with the _jk literal. Lookups with it skips hashing
+    //!
+    //! auto &price = json["price"_jk];
+    struct Key {
+        std::string_view name;
+        uint64_t hash;
+
+        constexpr Key(std::string_view name)
+            : name(name), hash(hashKey(name)) {}
+    };
+
     //! Find child
     //! IF child does not exist, create a new child and return that
-    Json &operator[](std::string n) {
+    Json &operator[](std::string_view n) {
         type = Object; // The operation converts the Json-object to a object
         value = "";
         auto f = find(n);
@@ -153,40 +490,158 @@ public:
 
     //! Char version of []
     Json &operator[](const char *name) {
-        return operator[](std::string(name));
+        return operator[](std::string_view{name});
     }
 
     //! Const version of []
     //! @throws std::out_of_range if child is not found
-    const Json &operator[](std::string n) const {
+    const Json &operator[](std::string_view n) const {
         auto f = find(n);
         if (f != end()) {
             return *f;
         }
         else {
-            throw std::out_of_range("could not find " + n + " in json");
+            JSON_THROW(std::out_of_range("could not find " + std::string{n} +
+                                         " in json"));
         }
     }
 
-    //! Try to find a child with a specific name
-    //! @return the iterator with the child or end() if not found
-    iterator find(std::string name) {
-        for (auto it = begin(); it != end(); ++it) {
-            if ((*it).name == name) {
-                return it;
+    const Json &operator[](const char *name) const {
+        return operator[](std::string_view{name});
+    }
+
+    //! Same as operator[](name) for a precalculated key
+    Json &operator[](Key key) {
+        type = Object;
+        value = "";
+        auto f = find(key);
+        if (f != end()) {
+            return *f;
+        }
+
+        push_back(Json());
+        back().name = key.name;
+        return back();
+    }
+
+    //! @throws std::out_of_range if child is not found
+    const Json &operator[](Key key) const {
+        auto f = find(key);
+        if (f != end()) {
+            return *f;
+        }
+        JSON_THROW(std::out_of_range("could not find " +
+                                     std::string{key.name} + " in json"));
+    }
+
+    //! Find child without creating it or throwing
+    //! @return pointer to the child or nullptr if not found
+    Json *tryGet(std::string_view name) {
+        auto f = find(name);
+        return f != end() ? &*f : nullptr;
+    }
+
+    const Json *tryGet(std::string_view name) const {
+        auto f = find(name);
+        return f != end() ? &*f : nullptr;
+    }
+
+    Json *tryGet(Key key) {
+        auto f = find(key);
+        return f != end() ? &*f : nullptr;
+    }
+
+    const Json *tryGet(Key key) const {
+        auto f = find(key);
+        return f != end() ? &*f : nullptr;
+    }
+
+    //! Get child by index
+    //! @return pointer to the child or nullptr if index is out of range
+    Json *tryGet(int index) {
+        keyIndex.reset();
+        return index >= 0 && static_cast<size_t>(index) < size()
+                   ? data() + index
+                   : nullptr;
+    }
+
+    const Json *tryGet(int index) const {
+        return index >= 0 && static_cast<size_t>(index) < size()
+                   ? data() + index
+                   : nullptr;
+    }
+
+    //! Get the value if the type matches, without throwing
+    //! T can be bool, std::string, std::string_view or an arithmetic type.
+    //! Integer types only get numbers that are integral and in range of T
+    //! @return the value or nothing if the type does not match
+    template <typename T>
+    std::optional<T> getIf() const {
+        if constexpr (std::is_same_v<T, bool>) {
+            if (type == Boolean) {
+                return value == "true";
             }
         }
-        return end();
+        else if constexpr (std::is_arithmetic_v<T>) {
+            if (type == Number) {
+                return numberValue.exact<T>();
+            }
+        }
+        else {
+            static_assert(std::is_same_v<T, std::string> ||
+                              std::is_same_v<T, std::string_view>,
+                          "getIf only supports bool, numbers and strings");
+            if (type == String) {
+                return T{value};
+            }
+        }
+        return std::nullopt;
+    }
+
+    //! Try to find a child with a specific name
+    //! Large objects uses a hash index that is built on first lookup
+    //! @return the iterator with the child or end() if not found
+    iterator find(std::string_view name) {
+        return find(name, hashKey(name));
     }
 
     //! const version of above
-    const_iterator find(std::string name) const {
-        for (auto it = begin(); it != end(); ++it) {
-            if ((*it).name == name) {
-                return it;
-            }
+    const_iterator find(std::string_view name) const {
+        return find(name, hashKey(name));
+    }
+
+    //! Same as find(name) when the hash is already known
+    //! @param hash must be hashKey(name)
+    iterator find(std::string_view name, uint64_t hash) {
+        if (size() < JSON_KEY_INDEX_THRESHOLD) {
+            return begin() + findLinear(*this, name);
         }
-        return end();
+        return begin() + keyIndex.find(*this, name, hash);
+    }
+
+    const_iterator find(std::string_view name, uint64_t hash) const {
+        if (size() < JSON_KEY_INDEX_THRESHOLD) {
+            return begin() + findLinear(*this, name);
+        }
+        return begin() + keyIndex.findShared(*this, name, hash);
+    }
+
+    iterator find(Key key) {
+        return find(key.name, key.hash);
+    }
+
+    const_iterator find(Key key) const {
+        return find(key.name, key.hash);
+    }
+
+    //! Hash function used for object keys, usable at compile time
+    static constexpr uint64_t hashKey(std::string_view key) {
+        uint64_t hash = 14695981039346656037ull;
+        for (auto c : key) {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 1099511628211ull;
+        }
+        return hash;
     }
 
     //! Compare to string
@@ -194,8 +649,32 @@ public:
         return this->value == value;
     }
 
+    //! Compare type and content of this value and all children
+    //! Names of the values themselves and the order of members in objects
+    //! does not matter. Numbers are equal if they have the same value
+    bool operator==(const Json &other) const;
+
+    bool operator!=(const Json &other) const {
+        return !(*this == other);
+    }
+
+    //! Hash of the content, equal values have the same hash
+    //! Calculated for the whole tree on each call
+    uint64_t hash() const {
+        return hashTree(*this, nullptr);
+    }
+
+    //! Create a JSON Patch (RFC 6902) with operations that changes from to to
+    //! Subtrees with the same hash, type and number of values are treated as
+    //! equal without comparing them, so both trees are only walked once to
+    //! calculate the hashes. Elements that are inserted or removed in arrays
+    //! are found by their hash, other changes are written for each element.
+    //! Only "add", "remove" and "replace" operations are used
+    static Json Diff(const Json &from, const Json &to);
+
     //! Copy value from other json object
     Json &operator=(const Json &json) {
+        keyIndex.reset();
         type = json.type;
         if (type == Array || type == Object) {
             value.clear();
@@ -209,6 +688,7 @@ public:
             name = json.name;
             pos = json.pos;
         }
+        numberValue = json.numberValue;
         return *this;
     }
 
@@ -223,6 +703,7 @@ public:
         else
             value = std::move(json.value);
         name = std::move(json.name);
+        numberValue = json.numberValue;
         return *this;
     }
 
@@ -232,7 +713,10 @@ public:
     }
 
     //! Get the underlying vector type
+    //! Since the vector can be modified through the reference the key index
+    //! is rebuilt on next lookup
     std::vector<Json> &vector() {
+        keyIndex.reset();
         return *((std::vector<Json> *)this);
     }
 
@@ -276,6 +760,9 @@ public:
     //! Bool operation that can be used in if-statements to check if a child is
     //! set
     operator bool() {
+        if (type == Number) {
+            return true;
+        }
         if (type == None || type == Null || value.empty()) {
             return false;
         }
@@ -290,12 +777,53 @@ public:
     }
 
     iterator remove(const char *name) {
-        return remove(std::string(name));
+        return remove(std::string_view(name));
     }
 
-    iterator remove(std::string name) {
+    iterator remove(std::string_view name) {
         auto f = find(name);
-        return vector().erase(f);
+        if (f == end()) {
+            return f;
+        }
+        return erase(f);
+    }
+
+    // Functions from std::vector that moves or removes children. They are
+    // wrapped to keep the key index up to date. Adding children at the end is
+    // handled on next lookup
+
+    template <typename... Args>
+    iterator erase(Args &&...args) {
+        keyIndex.reset();
+        return std::vector<Json>::erase(std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    iterator insert(Args &&...args) {
+        keyIndex.reset();
+        return std::vector<Json>::insert(std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    iterator emplace(Args &&...args) {
+        keyIndex.reset();
+        return std::vector<Json>::emplace(std::forward<Args>(args)...);
+    }
+
+    void clear() noexcept {
+        keyIndex.reset();
+        std::vector<Json>::clear();
+    }
+
+    void pop_back() {
+        keyIndex.reset();
+        std::vector<Json>::pop_back();
+    }
+
+    template <typename... Args>
+    void resize(Args &&...args) {
+        keyIndex.reset();
+        std::vector<Json>::resize(std::forward<Args>(args)...);
     }
 
     static void indent(std::ostream &stream, int spaces) {
@@ -304,11 +832,19 @@ public:
         }
     }
 
-    std::string stringify(int indent = 4) const {
-        std::ostringstream ss;
-        stringify(ss, indent, 0);
-        return ss.str();
-    }
+    //! Indentation that gives output without any whitespace
+    static constexpr int compact = -1;
+
+    //! Convert to json text
+    //! @param indent spaces per level, or Json::compact for no whitespace
+    std::string stringify(int indent = 4) const;
+
+    //! Append the json text to out
+    //! Reuse the same string to avoid allocating for each call
+    void stringify(std::string &out, int indent = 4) const;
+
+    //! Number of characters that stringify() would output
+    size_t stringifiedSize(int indent = 4) const;
 
     //! Return line number of where the object was found in file or string
     constexpr size_t line() const {
@@ -332,7 +868,7 @@ public:
             return value;
         }
         else {
-            throw std::runtime_error("Type in json is not string");
+            JSON_THROW(std::runtime_error("Type in json is not string"));
         }
     }
 
@@ -344,7 +880,7 @@ public:
         return *this;
     }
 
-    static void escapeString(std::ostream &stream, std::string str);
+    static void escapeString(std::ostream &stream, std::string_view str);
 
     void stringify(std::ostream &stream,
                    int indent = 4,
@@ -373,16 +909,298 @@ public:
         }
     };
 
+    //! Numeric value of a Json object of type Number
+    //! Parsed numbers are decoded once when parsed and not stored as text
+    struct NumberValue {
+        enum Kind : unsigned char {
+            Integer,
+            Unsigned, // Only used for values that does not fit in Integer
+            Floating,
+        };
+
+        union {
+            int64_t integer = 0;
+            uint64_t unsignedInteger;
+            double floating;
+        };
+        Kind kind = Integer;
+
+        NumberValue() = default;
+
+        template <typename T>
+        explicit NumberValue(T value) {
+            if constexpr (std::is_floating_point_v<T>) {
+                kind = Floating;
+                floating = static_cast<double>(value);
+            }
+            else if constexpr (std::is_signed_v<T>) {
+                integer = static_cast<int64_t>(value);
+            }
+            else if (static_cast<uint64_t>(value) >
+                     static_cast<uint64_t>(INT64_MAX)) {
+                kind = Unsigned;
+                unsignedInteger = static_cast<uint64_t>(value);
+            }
+            else {
+                integer = static_cast<int64_t>(value);
+            }
+        }
+
+        //! Convert to an arithmetic type
+        //! Conversion to integer types truncates floating point values
+        //! towards zero and clamps values outside of the range of T to the
+        //! closest value of T. NaN is converted to 0
+        template <typename T>
+        T as() const {
+            if constexpr (std::is_floating_point_v<T>) {
+                switch (kind) {
+                case Integer:
+                    return static_cast<T>(integer);
+                case Unsigned:
+                    return static_cast<T>(unsignedInteger);
+                default:
+                    return static_cast<T>(floating);
+                }
+            }
+            else {
+                using Limits = std::numeric_limits<T>;
+                switch (kind) {
+                case Integer:
+                    if constexpr (std::is_signed_v<T>) {
+                        return static_cast<T>(std::clamp<int64_t>(
+                            integer, Limits::min(), Limits::max()));
+                    }
+                    else {
+                        if (integer < 0) {
+                            return 0;
+                        }
+                        return static_cast<T>(std::min<uint64_t>(
+                            static_cast<uint64_t>(integer), Limits::max()));
+                    }
+                case Unsigned:
+                    return static_cast<T>(
+                        std::min<uint64_t>(unsignedInteger, Limits::max()));
+                default:
+                    if (std::isnan(floating)) {
+                        return 0;
+                    }
+                    if (floating <= static_cast<double>(Limits::min())) {
+                        return Limits::min();
+                    }
+                    // Limits::max() + 1, exact as a double
+                    if (floating >= std::ldexp(1., Limits::digits)) {
+                        return Limits::max();
+                    }
+                    return static_cast<T>(floating);
+                }
+            }
+        }
+
+        //! Convert to T only if T can hold the value
+        //! Integer types requires an integral value in the range of T,
+        //! floating point types always succeeds, converted as with as<T>()
+        template <typename T>
+        std::optional<T> exact() const {
+            auto value = as<T>();
+            if constexpr (std::is_integral_v<T>) {
+                if (canonical(NumberValue{value}) != canonical(*this)) {
+                    return std::nullopt;
+                }
+            }
+            return value;
+        }
+
+        //! Decode a json number
+        //! @return false if the text is not a valid number
+        static bool parse(std::string_view text, NumberValue &number) {
+            auto first = text.data();
+            auto last = first + text.size();
+
+            if (text.find_first_of(".eE") == std::string_view::npos) {
+                auto res = std::from_chars(first, last, number.integer);
+                if (res.ec == std::errc{} && res.ptr == last) {
+                    number.kind = Integer;
+                    return true;
+                }
+                if (res.ec == std::errc::result_out_of_range &&
+                    text.front() != '-') {
+                    res = std::from_chars(first, last, number.unsignedInteger);
+                    if (res.ec == std::errc{} && res.ptr == last) {
+                        number.kind = Unsigned;
+                        return true;
+                    }
+                }
+                // Too large integers are stored as floating point
+            }
+
+            number.kind = Floating;
+            auto res = std::from_chars(first, last, number.floating);
+            if (res.ptr != last || text.empty()) {
+                return false;
+            }
+            if (res.ec == std::errc::result_out_of_range) {
+                // Let strtod decide between infinity and zero
+                number.floating = std::strtod(std::string{text}.c_str(), 0);
+            }
+            else if (res.ec != std::errc{}) {
+                return false;
+            }
+            return true;
+        }
+
+        //! Write the shortest text that reads back to the same value
+        //! Json can not represent nan and infinity, they are written as null
+        //! @return pointer past the last written character
+        char *write(char *first, char *last) const {
+            switch (kind) {
+            case Integer:
+                return std::to_chars(first, last, integer).ptr;
+            case Unsigned:
+                return std::to_chars(first, last, unsignedInteger).ptr;
+            default:
+                if (!std::isfinite(floating)) {
+                    std::memcpy(first, "null", 4);
+                    return first + 4;
+                }
+                return std::to_chars(first, last, floating).ptr;
+            }
+        }
+
+        //! Enough to fit any number written by write()
+        static constexpr size_t maxLength = 32;
+    };
+
+    //! Base for handlers passed to ParseEvents. Inherit and hide the
+    //! functions that are needed. Return false from any function to stop.
+    //! Strings are only valid during the call.
+    struct EventHandler {
+        //! Hide with false to get strings with escape sequences as they are
+        //! in the input, which saves unescaping them
+        static constexpr bool decodeStrings = true;
+
+        bool onNull() {
+            return true;
+        }
+        bool onBool(bool) {
+            return true;
+        }
+        bool onNumber(NumberValue) {
+            return true;
+        }
+        bool onString(std::string_view) {
+            return true;
+        }
+        bool onBeginObject() {
+            return true;
+        }
+        //! Called with the name of each member before its value
+        bool onKey(std::string_view) {
+            return true;
+        }
+        bool onEndObject() {
+            return true;
+        }
+        bool onBeginArray() {
+            return true;
+        }
+        bool onEndArray() {
+            return true;
+        }
+    };
+
+    //! Hash table from names to child indices used by find() on large objects
+    //! Only indices are stored so the table survives reallocation of the
+    //! children. Children added at the end are indexed on next lookup and
+    //! other changes through Json functions clears the table. Each slot
+    //! also keeps the high bits of the hash, so a slot that points to a child
+    //! with another name is noticed when children are reordered through the
+    //! vector, and the table is rebuilt. A child renamed through a reference
+    //! is only found by the new name after the table is rebuilt.
+    class KeyIndex {
+    public:
+        KeyIndex() = default;
+        KeyIndex(const KeyIndex &) {} // The copy builds its own table
+        KeyIndex(KeyIndex &&other) noexcept
+            : table(other.table.exchange(nullptr)) {}
+
+        KeyIndex &operator=(const KeyIndex &) {
+            reset();
+            return *this;
+        }
+
+        KeyIndex &operator=(KeyIndex &&other) noexcept {
+            if (this != &other) {
+                reset();
+                table = other.table.exchange(nullptr);
+            }
+            return *this;
+        }
+
+        ~KeyIndex() {
+            reset();
+        }
+
+        void reset() {
+            if (table.load(std::memory_order_relaxed)) {
+                delete table.exchange(nullptr);
+            }
+        }
+
+        //! Lookup for when the json object is not shared between threads
+        //! Extends the table in place when children has been added
+        //! @return index of the child or children.size() if not found
+        size_t find(const std::vector<Json> &children,
+                    std::string_view name,
+                    uint64_t hash);
+
+        //! Lookup that is safe to call from multiple threads at once
+        //! An outdated table is replaced but kept alive until the table after
+        //! it is replaced too
+        size_t findShared(const std::vector<Json> &children,
+                          std::string_view name,
+                          uint64_t hash) const;
+
+    private:
+        struct Table;
+
+        //! Replace current with a table of all children
+        //! @return the new table, or the one set by another thread first
+        Table *replace(Table *current,
+                       const std::vector<Json> &children) const;
+
+        struct Table {
+            struct Slot {
+                uint32_t index; // Child index + 1, 0 means empty
+                uint32_t hash;  // High bits of the hash of the name
+            };
+
+            std::vector<Slot> slots;
+            size_t count = 0; // Number of children indexed
+            std::unique_ptr<Table> retired;
+
+            void add(const std::vector<Json> &children);
+
+            //! @param stale set if a slot with the same hash has another name
+            size_t find(const std::vector<Json> &children,
+                        std::string_view name,
+                        uint64_t hash,
+                        bool &stale) const;
+        };
+
+        mutable std::atomic<Table *> table{nullptr};
+    };
+
     // Member variables
     std::string name;
     std::string value;
     Position pos;
     Type type = None;
+    NumberValue numberValue;
 
     struct ParsingError : public std::exception {
         ParsingError(std::string info, Position position)
             : errorString(info + " at " + std::string{position}),
-              position(position) {}
+              position(position), info(std::move(info)) {}
 
         const char *what() const noexcept override {
             return errorString.c_str();
@@ -390,8 +1208,26 @@ public:
 
         std::string errorString;
         Position position;
+        std::string info; // Description without position
     };
 
+    //! Check that the text is valid json without building a tree
+    //! The checks are always strict, see ParseOptions::strict. Nothing is
+    //! allocated other than a stack of the open objects and arrays
+    //! @return the error or nothing if the text is valid
+    static std::optional<ParsingError> Validate(std::string_view str,
+                                                ParseOptions options = {});
+
+    //! Same as above but the whole stream is read into memory first
+    static std::optional<ParsingError> Validate(std::istream &stream,
+                                                ParseOptions options = {});
+
+    //! Same as parse(str) but errors in the text are returned instead of
+    //! thrown. The content is unspecified after an error
+    //! @return the error or nothing if the text was parsed
+    std::optional<ParsingError> tryParse(std::string_view str,
+                                         ParseOptions options = {});
+
     class Token {
     public:
         enum Type {
@@ -407,6 +1243,7 @@ public:
             Colon,
             BooleanTrue,
             BooleanFalse,
+            Error, // The error is stored in BufferInput::error
         };
 
         std::string value;
@@ -426,393 +1263,5474 @@ public:
             this->value = token.value;
             return *this;
         }
+
+        Token &operator=(Token &&token) {
+            this->type = token.type;
+            this->value = std::move(token.value);
+            return *this;
+        }
     };
 
-private:
-    static char getChar(std::istream &stream, Position &pos);
+    //! Read the whole content of a file into a string
+    //! Returns a empty string if the file could not be opened
+    static std::string readFile(const std::string &fname) {
+        auto file = std::ifstream{fname, std::ios::binary};
+        auto content = std::string{};
+        if (!file.seekg(0, std::ios::end)) {
+            return content;
+        }
+        auto size = file.tellg();
+        if (size <= 0) {
+            return content;
+        }
+        content.resize(static_cast<size_t>(size));
+        file.seekg(0);
+        file.read(content.data(), size);
+        content.resize(static_cast<size_t>(file.gcount()));
+        return content;
+    }
 
-    static Token getNextToken(std::istream &stream, Position &pos);
+    class FileMapping;
+    class Document;
+    class ConstRef;
+    class Lazy;
+    class Shared;
 
-    // Remove utf-8 byte order mask
-    static void removeBom(std::istream &stream) {
-        if (stream.peek() == 0xef) {
-            char dummy[3];
+    //! Parse only the parts that are accessed, see Json::Lazy
+    //! The string is not copied and has to outlive the result
+    static Lazy ParseLazy(std::string_view str, ParseOptions options = {});
+
+    class LineReader;
+    class IncrementalParser;
+    class Path;
+    class PathSet;
+
+    template <typename Sink>
+    class Writer;
+
+    //! Write values as newline delimited json, one value per line
+    //! The values are serialized in parallel and written in order
+    //! @param threads number of threads, 0 for one per hardware thread
+    static void WriteLines(std::ostream &stream,
+                           const std::vector<Json> &values,
+                           size_t threads = 0);
+
+private:
+    struct Scan;
+
+    KeyIndex keyIndex;
+
+    //! Hash and number of values in a subtree, see hashTree
+    struct TreeHash {
+        uint64_t hash = 0;
+        size_t size = 0;
+    };
+
+    //! Hash the value and its children
+    //! @param nodes if set, every value is added in depth first order
+    static uint64_t hashTree(const Json &json, std::vector<TreeHash> *nodes);
+
+    //! Numbers with a integer value are represented the same way regardless
+    //! of if they are stored as integers or floating point
+    static std::pair<NumberValue::Kind, uint64_t> canonical(
+        const NumberValue &number);
+
+    //! Append '/' and name to a JSON pointer, escaping '~' and '/'
+    static void appendPointer(std::string &pointer, std::string_view name);
+
+    class Differ;
+
+    //! @return index of the first child with the name or children.size()
+    static size_t findLinear(const std::vector<Json> &children,
+                             std::string_view name) {
+        for (size_t i = 0; i < children.size(); ++i) {
+            if (children[i].name == name) {
+                return i;
+            }
+        }
+        return children.size();
+    }
+
+    const NumberValue &numberOrThrow() const {
+        if (type != Number) {
+            JSON_THROW(std::runtime_error("Type in json is not number"));
+        }
+        return numberValue;
+    }
+
+    //! Range of memory that is being parsed
+    //! Used instead of std::istream when the whole input is available
+    struct BufferInput {
+        const char *it = nullptr;
+        const char *end = nullptr;
+
+        //! Set when positions are not counted while scanning, see
+        //! ParseOptions::positions. Errors are then located from here
+        const char *first = nullptr;
+
+        //! If set, errors are stored here instead of thrown, see reportError
+        std::optional<ParsingError> *error = nullptr;
+    };
+
+    static char getChar(std::istream &stream, Position &pos);
+
+    //! @param strict check strings as for ParseOptions::strict
+    static Token getNextToken(std::istream &stream,
+                              Position &pos,
+                              bool strict = false);
+
+    //! Stream with the last token read from it
+    struct StreamInput {
+        std::istream &stream;
+        Token token = {};
+        bool strict = false; // Strings are checked when read, see getNextToken
+    };
+
+    //! Token that refers to the input instead of owning its content
+    //! For strings the text is what is between the quotes and escaped tells
+    //! if the text needs to be passed through unescape()
+    struct RawToken {
+        Token::Type type = Token::None;
+        std::string_view text = {};
+        bool escaped = false;
+    };
+
+    //! Read the next token without allocating or decoding anything
+    static RawToken scanToken(BufferInput &input, Position &pos);
+
+    //! Read the next token from a stream, the text refers to input.token
+    static RawToken scanToken(StreamInput &input, Position &pos) {
+        input.token = getNextToken(input.stream, pos, input.strict);
+        return RawToken{input.token.type, input.token.value};
+    }
+
+    //! Append the decoded content of a escaped string to out
+    //! The escape sequences must already be validated by scanToken
+    static void unescape(std::string_view raw, std::string &out);
+
+    //! Characters that can follow the first character in a number
+    static constexpr bool isNumberCharacter(int c) {
+        return (c >= '0' && c <= '9') || c == '.' || c == 'e' || c == 'E' ||
+               c == '-' || c == '+';
+    }
+
+    //! Move the position forward over a range of already scanned characters
+    static void advance(BufferInput &input,
+                        Position &pos,
+                        const char *first,
+                        const char *last) {
+        if (!input.first) {
+            advance(pos, first, last);
+        }
+    }
+
+    static void advance(Position &pos, const char *first, const char *last) {
+        auto count = std::count(first, last, '\n');
+        if (count) {
+            pos.line += static_cast<unsigned>(count);
+            auto lastLine = last;
+            while (lastLine[-1] != '\n') {
+                --lastLine;
+            }
+            pos.col = static_cast<unsigned>(last - lastLine) + 1;
+        }
+        else {
+            pos.col += static_cast<unsigned>(last - first);
+        }
+    }
+
+    // Remove utf-8 byte order mask
+    static void removeBom(std::istream &stream) {
+        if (stream.peek() == 0xef) {
+            char dummy[3];
             stream.read(dummy, 3);
         }
     }
 
-    // Internal parse function
-    void parse(std::istream &ss, Position &pos, Token rest = Token());
-};
+    static void removeBom(StreamInput &input) {
+        removeBom(input.stream);
+    }
+
+    static void removeBom(BufferInput &input) {
+        if (input.end - input.it >= 3 &&
+            std::memcmp(input.it, "\xef\xbb\xbf", 3) == 0) {
+            input.it += 3;
+        }
+    }
+
+    //! Checks for ParseOptions::strict, strings are only checked here when
+    //! read from a buffer since the stream tokenizer decodes them
+    //! @return description of the error, empty if the token is allowed
+    static std::string strictError(BufferInput &, const RawToken &token);
+
+    static std::string strictError(StreamInput &, const RawToken &token) {
+        if (token.type == Token::Number && !isStrictNumber(token.text)) {
+            return "invalid number: " + std::string{token.text};
+        }
+        return {};
+    }
+
+    //! True if the text is a number as defined by RFC 8259
+    static bool isStrictNumber(std::string_view text);
+
+    //! Throw a parsing error, or store it when input.error is set
+    //! The first stored error is kept and the scanner and parser stops by
+    //! themselves after reporting it
+    static void reportError(BufferInput &input,
+                            std::string info,
+                            const Position &pos) {
+        if (!input.error) {
+            JSON_THROW(ParsingError(std::move(info), pos));
+        }
+        if (!*input.error) {
+            input.error->emplace(std::move(info), pos);
+        }
+    }
+
+    static void reportError(StreamInput &,
+                            std::string info,
+                            const Position &pos) {
+        JSON_THROW(ParsingError(std::move(info), pos));
+    }
+
+    //! Skip whitespace
+    //! @return true if there is nothing else left in the input
+    static bool atEnd(BufferInput &input, Position &pos) {
+        return scanToken(input, pos).type == Token::None;
+    }
+
+    static bool atEnd(StreamInput &input, Position &pos) {
+        while (std::isspace(input.stream.peek())) {
+            getChar(input.stream, pos);
+        }
+        return input.stream.peek() == std::char_traits<char>::eof();
+    }
+
+    //! Handler for Validate that does nothing
+    struct Validator;
+
+    //! The parser used for all input, reads tokens from input and calls the
+    //! handler. Uses a stack on the heap instead of recursion
+    template <typename Input, typename Handler>
+    static bool parseEvents(Input &input,
+                            Position &pos,
+                            Handler &handler,
+                            const ParseOptions &options);
+
+    //! parseEvents after the byte order mark is removed
+    template <typename Input, typename Handler>
+    static bool parseTokens(Input &input,
+                            Position &pos,
+                            Handler &handler,
+                            const ParseOptions &options);
+
+    //! Handler that builds a Json tree
+    struct TreeBuilder;
+
+    template <typename T>
+    struct IsVector : std::false_type {};
+
+    template <typename T, typename Allocator>
+    struct IsVector<std::vector<T, Allocator>> : std::true_type {};
+
+    template <typename T>
+    struct IsOptional : std::false_type {};
+
+    template <typename T>
+    struct IsOptional<std::optional<T>> : std::true_type {};
+
+    //! True if jsonFields() is found for T
+    template <typename T, typename = void>
+    struct HasFields : std::false_type {};
+
+    template <typename T>
+    struct HasFields<
+        T,
+        std::void_t<decltype(jsonFields(static_cast<const T *>(nullptr)))>>
+        : std::true_type {};
+
+    //! Hash table from names to fields created at compile time
+    template <typename T>
+    struct FieldTable;
+
+    //! Reads tokens directly into typed values
+    template <typename Input>
+    class TypedReader;
+
+    //! Updates ParseStats during parsing, does nothing when JSON_PARSE_STATS
+    //! is not defined
+    template <typename Input>
+    class StatsRecorder;
+
+    static size_t offset(const BufferInput &input) {
+        return reinterpret_cast<size_t>(input.it);
+    }
+
+    static size_t offset(StreamInput &input) {
+        auto pos = input.stream.tellg();
+        return pos < 0 ? 0 : static_cast<size_t>(pos);
+    }
+
+    struct StreamSink;
+    struct SizeSink;
+
+    //! Writes CBOR to a sink
+    template <typename Sink>
+    class BinaryWriter;
+
+    //! Reads CBOR from a BufferInput or a StreamInput
+    template <typename Input>
+    class BinaryReader;
+
+    //! Part of the output of a parallel stringify
+    struct Chunk {
+        std::string text;             // Written before the children
+        const Json *parent = nullptr; // Container of the children, if any
+        size_t first = 0;             // Range of children to write
+        size_t last = 0;
+        int level = 0;
+        std::string children = {};
+    };
+
+    //! Split the output in chunks where large containers are split between
+    //! several chunks, and write everything else to the chunk texts
+    void planChunks(std::vector<Chunk> &chunks,
+                    int indent,
+                    int level,
+                    const StringifyOptions &options) const;
+
+    //! Split the output and write the children of all chunks in parallel
+    std::vector<Chunk> writeChunks(int indent,
+                                   const StringifyOptions &options) const;
+
+    //! Number of threads to use when 0 means one per hardware thread
+    static size_t threadCount(size_t threads) {
+        if (threads) {
+            return threads;
+        }
+        return std::max(std::thread::hardware_concurrency(), 1u);
+    }
+};
+
+//! Key for lookups in Json objects with the hash calculated at compile time
+//!
+//! constexpr auto price = "price"_jk;
+constexpr Json::Key operator""_jk(const char *name, size_t size) {
+    return Json::Key{std::string_view{name, size}};
+}
+
+//! Functions for finding the next interesting character in a buffer
+//! Uses sse2 or avx2 when available, the implementation is selected at runtime
+struct Json::Scan {
+    //! Find the next '"', '\\' or control character
+    //! @return pointer to the character or end if not found
+    static const char *stringSpecial(const char *it, const char *end) {
+#if defined(JSON_AVX2)
+        static const auto f = __builtin_cpu_supports("avx2")
+                                  ? stringSpecialAvx2
+                                  : stringSpecialSse2;
+        return f(it, end);
+#elif defined(JSON_SSE2)
+        return stringSpecialSse2(it, end);
+#else
+        return stringSpecialScalar(it, end);
+#endif
+    }
+
+    //! Find the first character that is not json whitespace
+    static const char *whitespaceEnd(const char *it, const char *end) {
+        // Most whitespace sequences are short so check the first character
+        // before going into the vectorized version
+        if (it == end || !isWhitespace(*it)) {
+            return it;
+        }
+        ++it;
+#if defined(JSON_AVX2)
+        static const auto f = __builtin_cpu_supports("avx2")
+                                  ? whitespaceEndAvx2
+                                  : whitespaceEndSse2;
+        return f(it, end);
+#elif defined(JSON_SSE2)
+        return whitespaceEndSse2(it, end);
+#else
+        return whitespaceEndScalar(it, end);
+#endif
+    }
+
+    //! Find the next '"', '{', '}', '[' or ']', used to skip values
+    static const char *bracketOrQuote(const char *it, const char *end) {
+#if defined(JSON_AVX2)
+        static const auto f = __builtin_cpu_supports("avx2")
+                                  ? bracketOrQuoteAvx2
+                                  : bracketOrQuoteSse2;
+        return f(it, end);
+#elif defined(JSON_SSE2)
+        return bracketOrQuoteSse2(it, end);
+#else
+        return bracketOrQuoteScalar(it, end);
+#endif
+    }
+
+    static constexpr bool isWhitespace(char c) {
+        return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+    }
+
+    static constexpr bool isStringSpecial(char c) {
+        return c == '"' || c == '\\' || static_cast<unsigned char>(c) < 0x20;
+    }
+
+    static const char *stringSpecialScalar(const char *it, const char *end) {
+        while (it != end && !isStringSpecial(*it)) {
+            ++it;
+        }
+        return it;
+    }
+
+    static const char *whitespaceEndScalar(const char *it, const char *end) {
+        while (it != end && isWhitespace(*it)) {
+            ++it;
+        }
+        return it;
+    }
+
+    static constexpr bool isBracketOrQuote(char c) {
+        return c == '"' || c == '[' || c == ']' || c == '{' || c == '}';
+    }
+
+    static const char *bracketOrQuoteScalar(const char *it, const char *end) {
+        while (it != end && !isBracketOrQuote(*it)) {
+            ++it;
+        }
+        return it;
+    }
+
+    static int countTrailingZeros(unsigned mask) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return static_cast<int>(index);
+#else
+        return __builtin_ctz(mask);
+#endif
+    }
+
+#ifdef JSON_SSE2
+    static const char *stringSpecialSse2(const char *it, const char *end) {
+        const auto quote = _mm_set1_epi8('"');
+        const auto backslash = _mm_set1_epi8('\\');
+        const auto control = _mm_set1_epi8(0x1f);
+        for (; end - it >= 16; it += 16) {
+            auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(it));
+            auto m = _mm_or_si128(_mm_cmpeq_epi8(v, quote),
+                                  _mm_cmpeq_epi8(v, backslash));
+            // Unsigned v <= 0x1f
+            m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_min_epu8(v, control), v));
+            if (auto mask = static_cast<unsigned>(_mm_movemask_epi8(m))) {
+                return it + countTrailingZeros(mask);
+            }
+        }
+        return stringSpecialScalar(it, end);
+    }
+
+    static const char *bracketOrQuoteSse2(const char *it, const char *end) {
+        // '{' and '}' are '[' and ']' with bit 5 set
+        const auto quote = _mm_set1_epi8('"');
+        const auto bit5 = _mm_set1_epi8(0x20);
+        const auto open = _mm_set1_epi8('{');
+        const auto close = _mm_set1_epi8('}');
+        for (; end - it >= 16; it += 16) {
+            auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(it));
+            auto u = _mm_or_si128(v, bit5);
+            auto m = _mm_or_si128(
+                _mm_cmpeq_epi8(v, quote),
+                _mm_or_si128(_mm_cmpeq_epi8(u, open),
+                             _mm_cmpeq_epi8(u, close)));
+            if (auto found = static_cast<unsigned>(_mm_movemask_epi8(m))) {
+                return it + countTrailingZeros(found);
+            }
+        }
+        return bracketOrQuoteScalar(it, end);
+    }
+
+    static const char *whitespaceEndSse2(const char *it, const char *end) {
+        for (; end - it >= 16; it += 16) {
+            auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(it));
+            auto m = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                             _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))),
+                _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')),
+                             _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))));
+            if (auto mask = ~static_cast<unsigned>(_mm_movemask_epi8(m)) &
+                            0xffffu) {
+                return it + countTrailingZeros(mask);
+            }
+        }
+        return whitespaceEndScalar(it, end);
+    }
+#endif
+
+#ifdef JSON_AVX2
+    __attribute__((target("avx2"))) static const char *stringSpecialAvx2(
+        const char *it, const char *end) {
+        const auto quote = _mm256_set1_epi8('"');
+        const auto backslash = _mm256_set1_epi8('\\');
+        const auto control = _mm256_set1_epi8(0x1f);
+        for (; end - it >= 32; it += 32) {
+            auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(it));
+            auto m = _mm256_or_si256(_mm256_cmpeq_epi8(v, quote),
+                                     _mm256_cmpeq_epi8(v, backslash));
+            m = _mm256_or_si256(
+                m, _mm256_cmpeq_epi8(_mm256_min_epu8(v, control), v));
+            if (auto mask = static_cast<unsigned>(_mm256_movemask_epi8(m))) {
+                return it + countTrailingZeros(mask);
+            }
+        }
+        return stringSpecialSse2(it, end);
+    }
+
+    __attribute__((target("avx2"))) static const char *bracketOrQuoteAvx2(
+        const char *it, const char *end) {
+        const auto quote = _mm256_set1_epi8('"');
+        const auto bit5 = _mm256_set1_epi8(0x20);
+        const auto open = _mm256_set1_epi8('{');
+        const auto close = _mm256_set1_epi8('}');
+        for (; end - it >= 32; it += 32) {
+            auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(it));
+            auto u = _mm256_or_si256(v, bit5);
+            auto m = _mm256_or_si256(
+                _mm256_cmpeq_epi8(v, quote),
+                _mm256_or_si256(_mm256_cmpeq_epi8(u, open),
+                                _mm256_cmpeq_epi8(u, close)));
+            if (auto found = static_cast<unsigned>(_mm256_movemask_epi8(m))) {
+                return it + countTrailingZeros(found);
+            }
+        }
+        return bracketOrQuoteSse2(it, end);
+    }
+
+    __attribute__((target("avx2"))) static const char *whitespaceEndAvx2(
+        const char *it, const char *end) {
+        for (; end - it >= 32; it += 32) {
+            auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(it));
+            auto m = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                                _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))),
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')),
+                                _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))));
+            if (auto mask = ~static_cast<unsigned>(_mm256_movemask_epi8(m))) {
+                return it + countTrailingZeros(mask);
+            }
+        }
+        return whitespaceEndSse2(it, end);
+    }
+#endif
+};
+
+//! Handle to a value inside a Json::Document
+//! Cheap to copy, and only valid as long as the document is alive
+class Json::ConstRef {
+public:
+    class iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = ConstRef;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = ConstRef;
+
+        iterator(const Document *document, size_t index, bool named)
+            : document(document), index(index), named(named) {}
+
+        ConstRef operator*() const {
+            return ConstRef{document, index, named};
+        }
+
+        iterator &operator++();
+
+        iterator operator++(int) {
+            auto ret = *this;
+            ++*this;
+            return ret;
+        }
+
+        bool operator==(const iterator &other) const {
+            return index == other.index;
+        }
+
+        bool operator!=(const iterator &other) const {
+            return index != other.index;
+        }
+
+    private:
+        const Document *document;
+        size_t index;
+        bool named;
+    };
+
+    //! @param named true if the value is a member of a object, then the node
+    //! before the value holds the name
+    ConstRef(const Document *document, size_t index, bool named = false)
+        : document(document), index(index), named(named) {}
+
+    Type type() const;
+
+    //! Name of the value if it is member of a object, otherwise empty
+    std::string_view name() const;
+
+    //! Try to get string value
+    //! @throw std::runtime_error if not of type String
+    std::string_view string() const;
+
+    //! @throw std::runtime_error if not of type Boolean
+    bool boolean() const;
+
+    //! @throw std::runtime_error if not of type Number
+    NumberValue number() const;
+
+    double asDouble() const {
+        return number().as<double>();
+    }
+
+    int64_t asInt64() const {
+        return number().as<int64_t>();
+    }
+
+    uint64_t asUInt64() const {
+        return number().as<uint64_t>();
+    }
+
+    //! Number of children for objects and arrays
+    size_t size() const;
+
+    bool empty() const {
+        return !size();
+    }
+
+    iterator begin() const;
+    iterator end() const;
+
+    //! Try to find a child with a specific name
+    //! @return iterator to the child or end() if not found
+    iterator find(std::string_view name) const;
+
+    //! @throws std::out_of_range if child is not found
+    ConstRef operator[](std::string_view name) const;
+
+    ConstRef operator[](const char *name) const {
+        return operator[](std::string_view{name});
+    }
+
+    //! Get child by index
+    //! Notice that this walks from the first child, prefer iterating
+    //! @throws std::out_of_range if index is out of range
+    ConstRef operator[](int index) const;
+
+    //! Create a modifiable Json object with the same content
+    Json toJson() const;
+
+    std::string stringify(int indent = 4) const;
+
+    void stringify(std::string &out, int indent = 4) const;
+
+    void stringify(std::ostream &stream,
+                   int indent = 4,
+                   int startIndent = 0) const;
+
+    friend std::ostream &operator<<(std::ostream &stream, ConstRef ref) {
+        ref.stringify(stream);
+        return stream;
+    }
+
+private:
+    const Document *document;
+    size_t index;
+    bool named;
+};
+
+//! Read only json stored as one flat array of nodes and one buffer with the
+//! content of all strings. Uses a fraction of the memory of a Json tree and is
+//! faster to traverse. Use toJson() to get a modifiable copy.
+//!
+//! auto doc = Json::Document::Parse(text);
+//! std::cout << doc["test"].string() << "\n";
+class Json::Document {
+public:
+    //! Values are stored in depth first order. Members of objects are stored
+    //! as a String node with the name followed by the value
+    struct Node {
+        uint8_t type = None;
+        NumberValue::Kind kind = NumberValue::Integer;
+        uint32_t size = 0; // Length of strings or number of children
+        union {
+            uint64_t offset = 0; // Start of string in the string buffer
+            uint64_t end;        // Index after the last descendant
+            int64_t integer;
+            uint64_t unsignedInteger;
+            double floating;
+        };
+
+        Node(Type type = None, NumberValue::Kind kind = NumberValue::Integer)
+            : type(static_cast<uint8_t>(type)), kind(kind) {}
+    };
+
+    Document() : nodes(1) {}
+
+    static Document Parse(std::string_view str, ParseOptions options = {});
+
+    static Document LoadFile(const std::string &fname,
+                             ParseOptions options = {});
+
+    //! Parse a memory mapped file where strings without escape sequences
+    //! refer to the mapping instead of being copied to the document. The file
+    //! stays mapped as long as the document or a copy of it exists, and should
+    //! not be modified during that time.
+    static Document MapFile(const std::string &fname,
+                            ParseOptions options = {});
+
+    ConstRef root() const {
+        return ConstRef{this, 0};
+    }
+
+    Type type() const {
+        return root().type();
+    }
+
+    size_t size() const {
+        return root().size();
+    }
+
+    ConstRef::iterator begin() const {
+        return root().begin();
+    }
+
+    ConstRef::iterator end() const {
+        return root().end();
+    }
+
+    ConstRef operator[](std::string_view name) const {
+        return root()[name];
+    }
+
+    ConstRef operator[](const char *name) const {
+        return root()[name];
+    }
+
+    ConstRef operator[](int index) const {
+        return root()[index];
+    }
+
+    Json toJson() const {
+        return root().toJson();
+    }
+
+    std::string stringify(int indent = 4) const {
+        return root().stringify(indent);
+    }
+
+    friend std::ostream &operator<<(std::ostream &stream,
+                                    const Document &document) {
+        return stream << document.root();
+    }
+
+    //! Number of bytes allocated by the document
+    //! Strings that refer to a mapped file are not included
+    size_t memoryUsage() const {
+        return nodes.capacity() * sizeof(Node) + strings.capacity() +
+               names.capacity() * sizeof(uint32_t);
+    }
+
+private:
+    friend ConstRef;
+
+    struct Builder;
+
+    //! Set in the offset of strings that refers to the mapped file
+    static constexpr uint64_t mappedBit = uint64_t{1} << 63;
+
+    static Document parse(std::string_view str,
+                          ParseOptions options,
+                          std::shared_ptr<const FileMapping> file);
+
+    std::string_view text(const Node &node) const;
+
+    //! Find a name when names are interned
+    //! @return index + 1 of the first node with the name or 0 if not found
+    size_t findName(std::string_view name) const;
+
+    std::vector<Node> nodes;
+    std::string strings;
+    std::shared_ptr<const FileMapping> file;
+
+    //! Hash table with index + 1 of the first node with each name, empty if
+    //! names are not interned
+    std::vector<uint32_t> names;
+};
+
+//! Read only content of a whole file
+//! The file is memory mapped where supported and read to memory otherwise
+//!
+//! auto file = Json::FileMapping{"large.json"};
+//! auto lazy = Json::ParseLazy(file.view());
+class Json::FileMapping {
+public:
+    //! The content is empty if the file could not be opened
+    explicit FileMapping(const std::string &fname);
+
+    FileMapping(const FileMapping &) = delete;
+    FileMapping &operator=(const FileMapping &) = delete;
+
+    ~FileMapping();
+
+    std::string_view view() const {
+        return {data, size};
+    }
+
+private:
+    const char *data = nullptr;
+    size_t size = 0;
+    std::string content; // Used when the file is not mapped
+};
+
+//! Value in a json text that is parsed when it is accessed. Looking up a child
+//! scans from the start of the parent and skips other values by matching
+//! brackets and quotes, without decoding strings or numbers. Malformed parts
+//! that are scanned give the same errors as Json::Parse, but content of
+//! skipped values is only checked for matching brackets and valid strings.
+//! Nothing is cached, so keep values that are used more than once.
+//!
+//! auto doc = Json::ParseLazy(text); // text has to outlive doc
+//! std::cout << doc["sub"]["value"].asInt64() << "\n";
+class Json::Lazy {
+public:
+    class iterator;
+
+    Type type() const;
+
+    //! Name of the value if it is member of a object, otherwise empty
+    std::string name() const;
+
+    //! Try to get string value
+    //! @throw std::runtime_error if not of type String
+    std::string string() const;
+
+    //! @throw std::runtime_error if not of type Boolean
+    bool boolean() const;
+
+    //! @throw std::runtime_error if not of type Number
+    //! @throw ParsingError if the number is malformed
+    NumberValue number() const;
+
+    double asDouble() const {
+        return number().as<double>();
+    }
+
+    int64_t asInt64() const {
+        return number().as<int64_t>();
+    }
+
+    uint64_t asUInt64() const {
+        return number().as<uint64_t>();
+    }
+
+    //! Number of children for objects and arrays
+    //! Notice that this scans all children
+    size_t size() const;
+
+    bool empty() const;
+
+    iterator begin() const;
+    iterator end() const;
+
+    //! Try to find a child with a specific name
+    //! @return iterator to the child or end() if not found
+    iterator find(std::string_view name) const;
+
+    //! @throws std::out_of_range if child is not found
+    Lazy operator[](std::string_view name) const;
+
+    Lazy operator[](const char *name) const {
+        return operator[](std::string_view{name});
+    }
+
+    //! Get child by index
+    //! Notice that this scans from the first child, prefer iterating
+    //! @throws std::out_of_range if index is out of range
+    Lazy operator[](int index) const;
+
+    //! The unparsed text of the value
+    std::string_view raw() const {
+        return {it, static_cast<size_t>(skip() - it)};
+    }
+
+    //! Parse the value fully
+    Json toJson() const;
+
+    std::string stringify(int indent = 4) const {
+        return toJson().stringify(indent);
+    }
+
+    //! Line number of the value, calculated when called
+    size_t line() const {
+        return position().line;
+    }
+
+    //! Column of the value, calculated when called
+    size_t col() const {
+        return position().col;
+    }
+
+    friend std::ostream &operator<<(std::ostream &stream, const Lazy &lazy) {
+        return stream << lazy.toJson();
+    }
+
+private:
+    friend Json;
+    friend Path;
+    friend PathSet;
+
+    Lazy(const char *first, const char *last, size_t maxDepth)
+        : first(first), it(last), next(last), last(last), maxDepth(maxDepth) {}
+
+    //! Read the value that starts at from (after whitespace)
+    //! @throw ParsingError if it is not the beginning of a value
+    Lazy value(const char *from, size_t depth) const;
+
+    //! Read the member that begins at from, including the name for objects
+    //! @param depth depth of the member
+    Lazy member(const char *from, bool isObject, size_t depth) const;
+
+    //! Read the next token with positions relative to the beginning
+    RawToken scan(BufferInput &input) const;
+
+    //! Find the end of a object or array where from is after the first bracket
+    const char *skipContainer(const char *from) const;
+
+    //! Compare the name without allocating when it is not escaped
+    //! @param buffer used to unescape the name
+    bool hasName(std::string_view name, std::string &buffer) const {
+        if (!escapedName) {
+            return rawName == name;
+        }
+        buffer.clear();
+        unescape(rawName, buffer);
+        return buffer == name;
+    }
+
+    //! Value that is not found
+    Lazy none() const {
+        return Lazy{first, last, maxDepth};
+    }
+
+    //! Get pointer to after the end of the value, same as it if not found
+    const char *skip() const {
+        if (it == last) {
+            return it;
+        }
+        return (*it == '{' || *it == '[') ? skipContainer(next) : next;
+    }
+
+    Position position(const char *at) const {
+        auto pos = Position{};
+        advance(pos, first, at);
+        return pos;
+    }
+
+    //! Position after the first token, same as for values in Json
+    Position position() const {
+        return position(next);
+    }
+
+    [[noreturn]] void fail(std::string info, const char *at) const {
+        JSON_THROW(ParsingError(std::move(info), position(at)));
+    }
+
+    const char *first; // Beginning of the document used to calculate positions
+    const char *it;    // Beginning of the value, end if no value
+    const char *next;  // After the first token of the value
+    const char *last;
+    std::string_view rawName = {}; // Name before unescaping
+    bool escapedName = false;
+    size_t depth = 0; // Number of objects and arrays containing the value
+    size_t maxDepth;
+};
+
+class Json::Lazy::iterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Lazy;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Lazy *;
+    using reference = const Lazy &;
+
+    iterator(Lazy current, bool isObject)
+        : current(current), isObject(isObject) {}
+
+    const Lazy &operator*() const {
+        return current;
+    }
+
+    const Lazy *operator->() const {
+        return &current;
+    }
+
+    iterator &operator++();
+
+    iterator operator++(int) {
+        auto ret = *this;
+        ++*this;
+        return ret;
+    }
+
+    bool operator==(const iterator &other) const {
+        return current.it == other.current.it;
+    }
+
+    bool operator!=(const iterator &other) const {
+        return current.it != other.current.it;
+    }
+
+private:
+    Lazy current;
+    bool isObject;
+};
+
+//! Location of a value that is parsed once and evaluated many times
+//! Segments are split, unescaped and hashed when the path is created.
+//! Both JSON pointers (RFC 6901) and dotted paths are accepted
+//!
+//! auto price = Json::Path{"/payload/items/3/price"};
+//! auto same = Json::Path{"payload.items[3].price"};
+//! if (auto value = price.find(json)) {
+//!     std::cout << value->asDouble() << "\n";
+//! }
+class Json::Path {
+public:
+    struct Segment {
+        std::string name;
+        uint64_t hash = 0;
+        size_t index = npos; // Array index or npos if name is not a index
+
+        explicit Segment(std::string name);
+
+        bool operator==(const Segment &other) const {
+            return name == other.name;
+        }
+    };
+
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    //! The root value
+    Path() = default;
+
+    //! A path beginning with '/' or an empty path is a JSON pointer, where
+    //! "~1" means '/' and "~0" means '~'. Other paths are names separated by
+    //! '.' where array indices can also be written as "[3]"
+    //! @throws std::invalid_argument if the path is malformed
+    Path(std::string_view path);
+
+    Path(const char *path) : Path(std::string_view{path}) {}
+
+    const std::vector<Segment> &segments() const {
+        return parts;
+    }
+
+    size_t size() const {
+        return parts.size();
+    }
+
+    bool empty() const {
+        return parts.empty();
+    }
+
+    //! The path as a JSON pointer
+    std::string pointer() const;
+
+    //! @return the value or nullptr if it is not found
+    const Json *find(const Json &json) const;
+
+    Json *find(Json &json) const {
+        return const_cast<Json *>(find(static_cast<const Json &>(json)));
+    }
+
+    //! Find the value without parsing anything outside of the path
+    //! @return the value or a value with type None if it is not found
+    Lazy find(const Lazy &lazy) const;
+
+    //! Find the value in unparsed text, see ParseLazy
+    //! The text has to outlive the result
+    Lazy scan(std::string_view text, ParseOptions options = {}) const {
+        return find(ParseLazy(text, options));
+    }
+
+    //! @throws std::out_of_range if the value is not found
+    const Json &get(const Json &json) const;
+
+    bool operator==(const Path &other) const {
+        return parts == other.parts;
+    }
+
+private:
+    friend PathSet;
+
+    //! Child of json that matches segment or nullptr
+    static const Json *child(const Json &json, const Segment &segment);
+
+    std::vector<Segment> parts;
+};
+
+//! Paths that are evaluated together in one pass over a document
+//! Paths with the same beginning only visit that part once and when
+//! scanning unparsed text the scan stops as soon as all values are found
+//!
+//! auto paths = Json::PathSet{{"/id", "/user/name", "/items/0"}};
+//! for (auto &value : paths.scan(line)) {
+//!     std::cout << value.raw() << "\n";
+//! }
+class Json::PathSet {
+public:
+    PathSet() = default;
+
+    PathSet(const std::vector<Path> &paths) {
+        for (auto &path : paths) {
+            add(path);
+        }
+    }
+
+    //! @return index of the path in results
+    size_t add(const Path &path);
+
+    //! Number of paths
+    size_t size() const {
+        return count;
+    }
+
+    //! Values in the same order as the paths, nullptr if not found
+    std::vector<const Json *> find(const Json &json) const;
+
+    //! Values in the same order as the paths, type None if not found
+    std::vector<Lazy> find(const Lazy &lazy) const;
+
+    //! Find the values in unparsed text, see ParseLazy
+    //! The text has to outlive the result
+    std::vector<Lazy> scan(std::string_view text,
+                           ParseOptions options = {}) const {
+        return find(ParseLazy(text, options));
+    }
+
+private:
+    //! Paths that shares a beginning shares nodes
+    struct Node {
+        Path::Segment segment;
+        std::vector<size_t> children = {};
+        std::vector<size_t> paths = {}; // Paths that ends here
+    };
+
+    void find(const Json &json,
+              const Node &node,
+              std::vector<const Json *> &values) const;
+
+    void find(const Lazy &lazy,
+              const Node &node,
+              std::vector<Lazy> &values,
+              std::string &buffer) const;
+
+    std::vector<Node> nodes = {Node{Path::Segment{""}}};
+    size_t count = 0;
+};
+
+//! Json value that is shared instead of copied, for example configuration
+//! that is given to many requests. Copying a Shared only increases a
+//! reference count and any number of threads can read the same value. The
+//! value is copied the first time it is changed while shared (copy on write)
+//!
+//! auto config = Json::Shared{Json::LoadFile("config.json")};
+//! auto database = config.at("database"); // No copy of the tree
+//! database.edit()["user"] = "someone";   // database gets its own copy here
+class Json::Shared {
+public:
+    Shared() = default;
+
+    Shared(Json json) : node(std::make_shared<Json>(std::move(json))) {}
+
+    //! The value, a empty Json if not set
+    const Json &get() const;
+
+    const Json &operator*() const {
+        return get();
+    }
+
+    const Json *operator->() const {
+        return &get();
+    }
+
+    //! Child with name that shares memory with this value
+    //! @throws std::out_of_range if child is not found
+    Shared at(std::string_view name) const;
+
+    //! Child at index that shares memory with this value
+    //! @throws std::out_of_range if index is out of range
+    Shared at(size_t index) const;
+
+    //! Get the value to change it, the value is copied first if it is shared
+    //! Other Shared instances and children from at() keeps the old value
+    //! @return reference that is valid until this instance is copied to
+    Json &edit();
+
+    //! True if no other instance refers to the same memory
+    bool unique() const {
+        return node.use_count() <= 1;
+    }
+
+    friend std::ostream &operator<<(std::ostream &stream,
+                                    const Shared &shared) {
+        return stream << shared.get();
+    }
+
+private:
+    Shared(std::shared_ptr<Json> node) : node(std::move(node)) {}
+
+    std::shared_ptr<Json> node;
+};
+
+//! Reader for newline delimited json (ndjson or json lines) where each line is
+//! a separate value. The input is read in large blocks that are parsed by a
+//! pool of threads. Only a limited number of blocks are read ahead, so memory
+//! usage does not depend on the size of the input. Empty lines are skipped.
+//!
+//! auto reader = Json::LineReader{"log.ndjson"};
+//! for (auto &json : reader) {
+//!     std::cout << json["message"].string() << "\n";
+//! }
+class Json::LineReader {
+public:
+    struct Options {
+        //! Number of parsing threads, 0 for one per hardware thread
+        size_t threads;
+
+        //! Approximate number of bytes in each block, lines are never split
+        size_t blockSize;
+
+        //! Number of blocks read ahead, 0 for two per thread
+        size_t maxBlocks;
+
+        //! Set to false to get blocks as soon as they are parsed
+        //! Lines within a block are always in order
+        bool ordered;
+
+        ParseOptions parseOptions;
+
+        // Values are set in the constructor to be usable as default arguments
+        Options()
+            : threads(0), blockSize(1 << 20), maxBlocks(0), ordered(true) {}
+    };
+
+    class iterator;
+
+    //! The stream has to outlive the reader
+    LineReader(std::istream &stream, Options options = {});
+
+    //! Read from a file, nothing is read if the file could not be opened
+    LineReader(const std::string &fname, Options options = {});
+
+    LineReader(const LineReader &) = delete;
+    LineReader &operator=(const LineReader &) = delete;
+
+    ~LineReader();
+
+    //! Move the next value into json
+    //! @return false at the end of the input
+    //! @throw ParsingError where the line is counted from the beginning of
+    //! the input. Reading can continue after the rest of the block
+    bool next(Json &json);
+
+    //! Call f with each remaining value
+    //! @return the number of values
+    template <typename F>
+    size_t forEach(F f) {
+        auto json = Json{};
+        size_t count = 0;
+        while (next(json)) {
+            f(json);
+            ++count;
+        }
+        return count;
+    }
+
+    iterator begin();
+    iterator end();
+
+private:
+    struct Block {
+        std::string text;
+        size_t line = 0; // Number of lines before the block
+        std::vector<Json> values = {};
+        std::exception_ptr error = {};
+        bool done = false;
+    };
+
+    void start();
+
+    //! Read blocks until enough blocks are read ahead
+    void fill();
+
+    void parse(Block &block);
+
+    void work();
+
+    std::unique_ptr<std::ifstream> file;
+    std::istream &stream;
+    Options options;
+    size_t line = 0;
+
+    // Blocks that are read but not returned, in the order of the input
+    std::deque<std::unique_ptr<Block>> blocks;
+
+    // Values of this block are returned before reading from other blocks
+    std::unique_ptr<Block> current;
+    size_t currentIndex = 0;
+
+    // The following are shared with the threads
+    std::mutex mutex;
+    std::condition_variable workAvailable;
+    std::condition_variable blockDone;
+    std::deque<Block *> pending;
+    bool stop = false;
+    std::vector<std::thread> threads;
+};
+
+class Json::LineReader::iterator {
+public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = Json;
+    using difference_type = std::ptrdiff_t;
+    using pointer = Json *;
+    using reference = Json &;
+
+    //! Reads the first value, a null reader is used as end
+    explicit iterator(LineReader *reader) : reader(reader) {
+        if (reader) {
+            ++*this;
+        }
+    }
+
+    Json &operator*() {
+        return json;
+    }
+
+    Json *operator->() {
+        return &json;
+    }
+
+    iterator &operator++() {
+        if (!reader->next(json)) {
+            reader = nullptr;
+        }
+        return *this;
+    }
+
+    bool operator==(const iterator &other) const {
+        return reader == other.reader;
+    }
+
+    bool operator!=(const iterator &other) const {
+        return reader != other.reader;
+    }
+
+private:
+    LineReader *reader;
+    Json json;
+};
+
+//! Serializer that writes json text to a sink in as few appends as possible
+//! The sink needs a function append(const char *data, size_t size), like
+//! std::string. Indentation is written from a precomputed string, and
+//! indent == Json::compact gives output without any whitespace.
+//!
+//! auto out = std::string{};
+//! Json::Writer<std::string>{out, Json::compact}.write(json);
+template <typename Sink>
+class Json::Writer {
+public:
+    Writer(Sink &sink, int indent = 4, int startIndent = 0)
+        : sink(sink), indent(indent), level(startIndent) {}
+
+    void write(const Json &json);
+
+    void write(ConstRef ref);
+
+    //! Write a quoted string with escape sequences
+    void writeString(std::string_view str);
+
+    //! Write a value of a type supported by Json::ParseInto
+    template <typename T>
+    void writeValue(const T &value);
+
+private:
+    void append(std::string_view str) {
+        sink.append(str.data(), str.size());
+    }
+
+    void writeNumber(const NumberValue &number) {
+        char buffer[NumberValue::maxLength];
+        auto end = number.write(buffer, buffer + sizeof(buffer));
+        sink.append(buffer, static_cast<size_t>(end - buffer));
+    }
+
+    //! Start a new line indented to the current level
+    void newline();
+
+    //! Write what comes before a child in a object or array
+    void beginChild(bool first, bool isObject, std::string_view name);
+
+    //! Write the children [first, last) of a container that is started at
+    //! the level before the current level
+    void writeChildren(const Json &json, size_t first, size_t last) {
+        auto isObject = json.type == Object;
+        for (auto i = first; i < last; ++i) {
+            auto &child = json.data()[i];
+            beginChild(i == 0, isObject, child.name);
+            write(child);
+        }
+    }
+
+    friend Json;
+
+    Sink &sink;
+    int indent;
+    int level;
+    std::string newlines = "\n"; // Newline followed by indentation
+};
+
+//! Sink that collects output and writes it to a stream in large chunks
+//! The rest is written when the sink is destroyed
+struct Json::StreamSink {
+    static constexpr size_t bufferSize = 1 << 14;
+
+    explicit StreamSink(std::ostream &stream) : stream(stream) {
+        buffer.reserve(bufferSize);
+    }
+
+    StreamSink(const StreamSink &) = delete;
+    StreamSink &operator=(const StreamSink &) = delete;
+
+    ~StreamSink() {
+        flush();
+    }
+
+    void append(const char *data, size_t size) {
+        if (buffer.size() + size > bufferSize) {
+            flush();
+            if (size > bufferSize) {
+                stream.write(data, static_cast<std::streamsize>(size));
+                return;
+            }
+        }
+        buffer.append(data, size);
+    }
+
+    void flush() {
+        stream.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        buffer.clear();
+    }
+
+    std::ostream &stream;
+    std::string buffer;
+};
+
+//! Sink that only counts characters
+struct Json::SizeSink {
+    void append(const char *, size_t count) {
+        size += count;
+    }
+
+    size_t size = 0;
+};
+
+//! Writes Json values as CBOR, to the same sinks as Writer
+template <typename Sink>
+class Json::BinaryWriter {
+public:
+    explicit BinaryWriter(Sink &sink) : sink(sink) {}
+
+    void write(const Json &json);
+
+private:
+    void append(uint8_t byte) {
+        auto c = static_cast<char>(byte);
+        sink.append(&c, 1);
+    }
+
+    //! Write the initial byte with the major type and the following argument
+    //! in the shortest form
+    void head(uint8_t major, uint64_t argument);
+
+    //! Write the size and content of a text string
+    void text(std::string_view str) {
+        head(3, str.size());
+        sink.append(str.data(), str.size());
+    }
+
+    Sink &sink;
+};
+
+template <typename Input>
+class Json::BinaryReader {
+public:
+    BinaryReader(Input &input, const ParseOptions &options)
+        : input(input), options(options) {
+        if constexpr (std::is_same_v<Input, BufferInput>) {
+            first = input.it;
+        }
+    }
+
+    void read(Json &json, size_t depth = 0);
+
+private:
+    [[noreturn]] void fail(std::string info) {
+        auto pos = Position{1, static_cast<unsigned>(offset() + 1)};
+        JSON_THROW(ParsingError(std::move(info), pos));
+    }
+
+    size_t offset() const {
+        if constexpr (std::is_same_v<Input, BufferInput>) {
+            return static_cast<size_t>(input.it - first);
+        }
+        else {
+            return consumed;
+        }
+    }
+
+    uint8_t byte() {
+        if constexpr (std::is_same_v<Input, BufferInput>) {
+            if (input.it == input.end) {
+                fail("Unexpected end of file ");
+            }
+            return static_cast<uint8_t>(*input.it++);
+        }
+        else {
+            auto c = input.stream.get();
+            if (c == std::char_traits<char>::eof()) {
+                fail("Unexpected end of file ");
+            }
+            ++consumed;
+            return static_cast<uint8_t>(c);
+        }
+    }
+
+    //! Get the next byte without reading it
+    int peek() {
+        if constexpr (std::is_same_v<Input, BufferInput>) {
+            return input.it == input.end ? -1
+                                         : static_cast<uint8_t>(*input.it);
+        }
+        else {
+            return input.stream.peek();
+        }
+    }
+
+    //! Append size bytes to out
+    void bytes(std::string &out, uint64_t size);
+
+    //! Upper limit for how many values that can follow, used when reserving
+    //! so malformed sizes does not allocate more than the input size
+    size_t remaining() const {
+        if constexpr (std::is_same_v<Input, BufferInput>) {
+            return static_cast<size_t>(input.end - input.it);
+        }
+        else {
+            return 1 << 12;
+        }
+    }
+
+    //! Read the argument that follows the initial byte
+    uint64_t argument(uint8_t info);
+
+    //! Read a text string where the initial byte is already read
+    void text(std::string &out, uint8_t info);
+
+    //! Read a array or object where size is npos for indefinite length
+    void container(Json &json, bool isObject, uint64_t size, size_t depth);
+
+    //! Read simple values and floating point numbers
+    void simple(Json &json, uint8_t info);
+
+    static constexpr uint64_t npos = static_cast<uint64_t>(-1);
+
+    Input &input;
+    const ParseOptions &options;
+    const char *first = nullptr; // Only for buffers
+    size_t consumed = 0;         // Only for streams
+};
+
+#ifdef JSON_PARSE_STATS
+
+//! Counters for one parse, enabled by defining JSON_PARSE_STATS and setting
+//! ParseOptions::stats. Not collected by LineReader since it parses on several
+//! threads.
+//!
+//! auto stats = Json::ParseStats{};
+//! auto options = Json::ParseOptions{};
+//! options.stats = &stats;
+//! auto json = Json::Parse(text, options);
+struct Json::ParseStats {
+    using Duration = std::chrono::nanoseconds;
+
+    size_t bytes = 0;                // Characters consumed from the input
+    size_t nodes[Boolean + 1] = {};  // Number of values of each Json::Type
+    size_t maxDepth = 0;             // Deepest nesting of objects and arrays
+    size_t stringBytes = 0;          // Bytes of strings and names passed on
+    size_t numberBytes = 0;          // Characters of numbers that are decoded
+    size_t escapedStrings = 0;       // Strings that are unescaped
+    size_t allocations = 0;          // Estimated allocations for a Json tree
+
+    Duration tokenizeTime = {}; // Reading tokens
+    Duration decodeTime = {};   // Unescaping strings and converting numbers
+    Duration buildTime = {};    // The rest, mostly spent in the handler
+
+    size_t nodeCount() const {
+        size_t count = 0;
+        for (auto n : nodes) {
+            count += n;
+        }
+        return count;
+    }
+};
+
+template <typename Input>
+class Json::StatsRecorder {
+public:
+    using Clock = std::chrono::steady_clock;
+    using TimePoint = Clock::time_point;
+
+    StatsRecorder(const ParseOptions &options, Input &input)
+        : stats(options.stats), input(input) {
+        if (stats) {
+            *stats = {};
+            start = now();
+            startOffset = offset(input);
+        }
+    }
+
+    StatsRecorder(const StatsRecorder &) = delete;
+    StatsRecorder &operator=(const StatsRecorder &) = delete;
+
+    ~StatsRecorder() {
+        if (stats) {
+            stats->bytes = offset(input) - startOffset;
+            stats->buildTime = std::chrono::duration_cast<ParseStats::Duration>(
+                                   now() - start) -
+                               stats->tokenizeTime - stats->decodeTime;
+        }
+    }
+
+    TimePoint now() const {
+        return stats ? Clock::now() : TimePoint{};
+    }
+
+    void tokenized(TimePoint from) {
+        if (stats) {
+            stats->tokenizeTime += now() - from;
+        }
+    }
+
+    void decoded(TimePoint from) {
+        if (stats) {
+            stats->decodeTime += now() - from;
+        }
+    }
+
+    void string(const RawToken &token) {
+        if (stats) {
+            stats->stringBytes += token.text.size();
+            stats->escapedStrings += token.escaped;
+            // Strings longer than this does not fit in std::string itself
+            stats->allocations += token.text.size() > 15;
+        }
+    }
+
+    void number(const RawToken &token) {
+        if (stats) {
+            stats->numberBytes += token.text.size();
+        }
+    }
+
+    //! @param depth number of open objects and arrays including the value
+    void value(Type type, size_t depth) {
+        if (!stats) {
+            return;
+        }
+        ++stats->nodes[type];
+        stats->maxDepth = std::max(stats->maxDepth, depth);
+        if (!children.empty()) {
+            // Vectors of children grows to 1, 2, 4, 8...
+            auto &count = children.back();
+            stats->allocations += (count & (count - 1)) == 0;
+            ++count;
+        }
+        if (type == Object || type == Array) {
+            children.push_back(0);
+        }
+    }
+
+    void close() {
+        if (stats) {
+            children.pop_back();
+        }
+    }
+
+private:
+    ParseStats *stats;
+    Input &input;
+    TimePoint start = {};
+    size_t startOffset = 0;
+    std::vector<size_t> children = {}; // Count for each open container
+};
+
+#else
+
+template <typename Input>
+class Json::StatsRecorder {
+public:
+    using TimePoint = int;
+
+    StatsRecorder(const ParseOptions &, Input &) {}
+
+    TimePoint now() const {
+        return 0;
+    }
+
+    void tokenized(TimePoint) {}
+    void decoded(TimePoint) {}
+    void string(const RawToken &) {}
+    void number(const RawToken &) {}
+    void value(Type, size_t) {}
+    void close() {}
+};
+
+#endif
+
+template <typename T>
+struct Json::FieldTable {
+    static constexpr auto fields = jsonFields(static_cast<const T *>(nullptr));
+    static constexpr size_t count = std::tuple_size_v<decltype(fields)>;
+
+    static constexpr auto names = std::apply(
+        [](auto... field) {
+            return std::array<std::string_view, sizeof...(field)>{field.name...};
+        },
+        fields);
+
+    static constexpr auto hashes = std::apply(
+        [](auto... field) {
+            return std::array<uint64_t, sizeof...(field)>{field.hash...};
+        },
+        fields);
+
+    //! Twice the number of fields rounded up to a power of two
+    static constexpr size_t slotCount() {
+        size_t size = 1;
+        while (size < count * 2) {
+            size *= 2;
+        }
+        return size;
+    }
+
+    //! Field index + 1 for each slot, 0 for empty slots
+    static constexpr auto slots = [] {
+        auto slots = std::array<uint16_t, slotCount()>{};
+        for (size_t i = 0; i < count; ++i) {
+            auto slot = hashes[i] & (slots.size() - 1);
+            while (slots[slot]) {
+                slot = (slot + 1) & (slots.size() - 1);
+            }
+            slots[slot] = static_cast<uint16_t>(i + 1);
+        }
+        return slots;
+    }();
+
+    //! @return the index of the field or count if not found
+    static size_t find(std::string_view name) {
+        auto hash = hashKey(name);
+        constexpr auto mask = slots.size() - 1;
+        for (auto slot = hash & mask; slots[slot]; slot = (slot + 1) & mask) {
+            auto index = slots[slot] - 1u;
+            if (hashes[index] == hash && names[index] == name) {
+                return index;
+            }
+        }
+        return count;
+    }
+
+    //! Call f with the field at a index that is only known at runtime
+    template <typename F>
+    static void visit(size_t index, F &&f) {
+        visit(index, f, std::make_index_sequence<count>{});
+    }
+
+    template <typename F, size_t... I>
+    static void visit(size_t index, F &f, std::index_sequence<I...>) {
+        ((index == I ? (f(std::get<I>(fields)), true) : false) || ...);
+    }
+};
+
+template <typename Input>
+class Json::TypedReader {
+public:
+    TypedReader(Input &input, const ParseOptions &options)
+        : input(input), options(options) {
+        removeBom(input);
+    }
+
+    template <typename T>
+    void read(T &value) {
+        read(value, next());
+    }
+
+private:
+    RawToken next() {
+        return scanToken(input, pos);
+    }
+
+    [[noreturn]] void fail(const std::string &expected, const RawToken &token) {
+        if (token.type == Token::None) {
+            JSON_THROW(ParsingError("Unexpected end of file ", pos));
+        }
+        JSON_THROW(ParsingError("expected " + expected + " got " +
+                                    std::string{token.text},
+                                pos));
+    }
+
+    std::string_view text(const RawToken &token) {
+        if (!token.escaped) {
+            return token.text;
+        }
+        decoded.clear();
+        unescape(token.text, decoded);
+        return decoded;
+    }
+
+    void enter() {
+        if (depth++ >= options.maxDepth) {
+            JSON_THROW(ParsingError("maximum depth exceeded", pos));
+        }
+    }
+
+    //! Read a coma or the end of a container
+    //! @return false at the end
+    bool separator(Token::Type end) {
+        auto token = next();
+        if (token.type == Token::Coma) {
+            return true;
+        }
+        if (token.type != end) {
+            fail(end == Token::EndBrace ? "',' or '}'" : "',' or ']'", token);
+        }
+        return false;
+    }
+
+    //! Skip a value that begins with token
+    void skip(RawToken token) {
+        if (token.type != Token::BeginBrace &&
+            token.type != Token::BeginBracket) {
+            switch (token.type) {
+            case Token::Null:
+            case Token::String:
+            case Token::Number:
+            case Token::BooleanTrue:
+            case Token::BooleanFalse:
+                return;
+            default:
+                fail("value", token);
+            }
+        }
+        // True for objects
+        auto stack = std::vector<bool>{token.type == Token::BeginBrace};
+        enter();
+        while (!stack.empty()) {
+            token = next();
+            switch (token.type) {
+            case Token::None:
+                fail("value", token);
+            case Token::BeginBrace:
+            case Token::BeginBracket:
+                enter();
+                stack.push_back(token.type == Token::BeginBrace);
+                break;
+            case Token::EndBrace:
+            case Token::EndBracket:
+                if ((token.type == Token::EndBrace) != stack.back()) {
+                    JSON_THROW(
+                        ParsingError("unexpected character in array: ", pos));
+                }
+                stack.pop_back();
+                --depth;
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    template <typename T>
+    void read(T &value, const RawToken &token);
+
+    Input &input;
+    const ParseOptions &options;
+    Position pos = {};
+    std::string decoded = {};
+    size_t depth = 0;
+};
+
+template <typename Input>
+template <typename T>
+inline void Json::TypedReader<Input>::read(T &value, const RawToken &token) {
+    if constexpr (std::is_same_v<T, bool>) {
+        if (token.type != Token::BooleanTrue &&
+            token.type != Token::BooleanFalse) {
+            fail("boolean", token);
+        }
+        value = token.type == Token::BooleanTrue;
+    }
+    else if constexpr (std::is_arithmetic_v<T>) {
+        if (token.type != Token::Number) {
+            fail("number", token);
+        }
+        auto number = NumberValue{};
+        if (!NumberValue::parse(token.text, number)) {
+            JSON_THROW(ParsingError(
+                "invalid number: " + std::string{token.text}, pos));
+        }
+        auto exact = number.exact<T>();
+        if (!exact) {
+            JSON_THROW(ParsingError("number does not fit in type: " +
+                                        std::string{token.text},
+                                    pos));
+        }
+        value = *exact;
+    }
+    else if constexpr (std::is_same_v<T, std::string>) {
+        if (token.type != Token::String) {
+            fail("string", token);
+        }
+        value.assign(text(token));
+    }
+    else if constexpr (IsOptional<T>::value) {
+        if (token.type == Token::Null) {
+            value.reset();
+        }
+        else {
+            read(value.emplace(), token);
+        }
+    }
+    else if constexpr (IsVector<T>::value) {
+        if (token.type != Token::BeginBracket) {
+            fail("array", token);
+        }
+        enter();
+        value.clear();
+        auto element = next();
+        if (element.type != Token::EndBracket) {
+            do {
+                read(value.emplace_back(), element);
+            } while (separator(Token::EndBracket) && (element = next(), true));
+        }
+        --depth;
+    }
+    else if constexpr (HasFields<T>::value) {
+        if (token.type != Token::BeginBrace) {
+            fail("object", token);
+        }
+        enter();
+        auto name = next();
+        if (name.type != Token::EndBrace) {
+            using Table = FieldTable<T>;
+            do {
+                if (name.type != Token::String) {
+                    fail("name", name);
+                }
+                auto index = Table::find(text(name));
+                auto colon = next();
+                if (colon.type != Token::Colon) {
+                    fail("':'", colon);
+                }
+                auto member = next();
+                if (index == Table::count) {
+                    skip(member);
+                }
+                else {
+                    Table::visit(index, [&](auto &field) {
+                        read(value.*(field.member), member);
+                    });
+                }
+            } while (separator(Token::EndBrace) && (name = next(), true));
+        }
+        --depth;
+    }
+    else {
+        static_assert(IsVector<T>::value, // Always false
+                      "Type is not supported, add JSON_FIELDS for structs");
+    }
+}
+
+template <typename T>
+inline T Json::ParseInto(std::string_view str, ParseOptions options) {
+    auto input = BufferInput{str.data(), str.data() + str.size()};
+    auto value = T{};
+    TypedReader<BufferInput>{input, options}.read(value);
+    return value;
+}
+
+template <typename T>
+inline T Json::ParseInto(std::istream &stream, ParseOptions options) {
+    auto input = StreamInput{stream};
+    auto value = T{};
+    TypedReader<StreamInput>{input, options}.read(value);
+    return value;
+}
+
+template <typename T>
+inline std::string Json::Serialize(const T &value, int indent) {
+    auto out = std::string{};
+    Writer<std::string>{out, indent}.writeValue(value);
+    return out;
+}
+
+/// Definition of internal functions-------------------------------------------
+
+inline void Json::KeyIndex::Table::add(const std::vector<Json> &children) {
+    if (children.size() * 2 > slots.size()) {
+        // Grow and reinsert everything, load factor is kept below 0.5
+        auto capacity = size_t{64};
+        while (capacity < children.size() * 4) {
+            capacity *= 2;
+        }
+        slots.assign(capacity, Slot{0, 0});
+        count = 0;
+    }
+
+    const auto mask = slots.size() - 1;
+    for (; count < children.size(); ++count) {
+        auto &name = children[count].name;
+        auto hash = hashKey(name);
+        auto high = static_cast<uint32_t>(hash >> 32);
+        for (auto i = hash & mask;; i = (i + 1) & mask) {
+            auto &slot = slots[i];
+            if (!slot.index) {
+                slot = {static_cast<uint32_t>(count + 1), high};
+                break;
+            }
+            if (slot.hash == high && children[slot.index - 1].name == name) {
+                break; // Duplicate key, the first one is used
+            }
+        }
+    }
+}
+
+inline size_t Json::KeyIndex::Table::find(const std::vector<Json> &children,
+                                          std::string_view name,
+                                          uint64_t hash,
+                                          bool &stale) const {
+    const auto mask = slots.size() - 1;
+    const auto high = static_cast<uint32_t>(hash >> 32);
+    for (auto i = hash & mask; slots[i].index; i = (i + 1) & mask) {
+        if (slots[i].hash != high) {
+            continue;
+        }
+        auto index = slots[i].index - 1;
+        if (children[index].name == name) {
+            return index;
+        }
+        stale = true;
+    }
+    return children.size();
+}
+
+inline size_t Json::KeyIndex::find(const std::vector<Json> &children,
+                                   std::string_view name,
+                                   uint64_t hash) {
+    auto current = table.load(std::memory_order_relaxed);
+    auto stale = false;
+    if (current && current->count <= children.size()) {
+        if (current->count < children.size()) {
+            current->add(children);
+        }
+        auto index = current->find(children, name, hash, stale);
+        if (!stale || index != children.size()) {
+            return index;
+        }
+    }
+    // No table yet, children removed or moved since they were indexed
+    reset();
+    current = new Table;
+    table.store(current, std::memory_order_relaxed);
+    current->add(children);
+    return current->find(children, name, hash, stale);
+}
+
+inline Json::KeyIndex::Table *Json::KeyIndex::replace(
+    Table *current, const std::vector<Json> &children) const {
+    auto fresh = std::make_unique<Table>();
+    fresh->add(children);
+    fresh->retired.reset(current);
+    if (table.compare_exchange_strong(current,
+                                      fresh.get(),
+                                      std::memory_order_acq_rel,
+                                      std::memory_order_acquire)) {
+        // Other threads can still use current but not the table before it,
+        // since tables are only outdated by changes that are not made while
+        // the object is shared
+        if (current) {
+            current->retired.reset();
+        }
+        return fresh.release();
+    }
+    // Another thread was first, use that table instead
+    fresh->retired.release();
+    return current;
+}
+
+inline size_t Json::KeyIndex::findShared(const std::vector<Json> &children,
+                                         std::string_view name,
+                                         uint64_t hash) const {
+    auto current = table.load(std::memory_order_acquire);
+    while (!current || current->count != children.size()) {
+        current = replace(current, children);
+    }
+    auto stale = false;
+    auto index = current->find(children, name, hash, stale);
+    if (stale && index == children.size()) {
+        // Children moved since they were indexed
+        current = replace(current, children);
+        index = current->find(children, name, hash, stale);
+    }
+    return index;
+}
+
+inline char Json::getChar(std::istream &stream, Json::Position &pos) {
+    if (stream.eof()) {
+        JSON_THROW(ParsingError("Unexpected end of file ", pos));
+    }
+    auto c = stream.get();
+    if (c == '\n') {
+        pos.col = 1;
+        ++pos.line;
+    }
+    else {
+        ++pos.col;
+    }
+    return c;
+}
+
+inline Json::Token Json::getNextToken(std::istream &stream,
+                                      Json::Position &pos,
+                                      bool strict) {
+    Token ret;
+
+    if (stream.eof()) {
+        JSON_THROW(ParsingError("End of file when expecting character", pos));
+    }
+    char c = getChar(stream, pos);
+
+    while (isspace(c)) {
+        c = getChar(stream, pos);
+        if (stream.eof()) {
+            JSON_THROW(
+                ParsingError("End of file when expecting character", pos));
+        }
+    }
+
+    if (c == '"') {
+        ret.type = Token::String;
+        c = getChar(stream, pos);
+        while (c != '"') {
+            if (c == '\\') {
+                c = getChar(stream, pos);
+                switch (c) {
+                case '"':
+                    ret.value += c;
+                    break;
+                case 'b':
+                    ret.value += '\b';
+                    break;
+                case 'r':
+                    ret.value += '\r';
+                    break;
+                case 't':
+                    ret.value += '\t';
+                    break;
+                case 'n':
+                    ret.value += '\n';
+                    break;
+                case '\\':
+                    ret.value += '\\';
+                    break;
+                case '/':
+                    ret.value += '/';
+                    break;
+                case 'f':
+                    ret.value += '\f';
+                    break;
+                case 'u':
+                    ret.value += "\\u";
+                    for (int i = 0; strict && i < 4; ++i) {
+                        c = getChar(stream, pos);
+                        if (!std::isxdigit(static_cast<unsigned char>(c))) {
+                            JSON_THROW(ParsingError(
+                                "expected four hex digits after \\u", pos));
+                        }
+                        ret.value += c;
+                    }
+                    break;
+                default:
+                    JSON_THROW(
+                        ParsingError("illegal character in string", pos));
+                    break;
+                }
+            }
+            else {
+                if (strict && static_cast<unsigned char>(c) < 0x20) {
+                    JSON_THROW(
+                        ParsingError("control character in string", pos));
+                }
+                ret.value += c;
+            }
+            c = getChar(stream, pos);
+        }
+        return ret;
+    }
+
+    auto assertEq = [&pos, &stream](char c) {
+        char nc = getChar(stream, pos);
+        return (nc == c);
+    };
+
+    auto assertWord = [&assertEq](std::string_view word) {
+        for (auto c : word) {
+            if (!assertEq(c)) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    if (isdigit(c) || c == '.' || c == '-') {
+        ret.value += c;
+
+        for (auto next = stream.peek(); isNumberCharacter(next);
+             next = stream.peek()) {
+            ret.value += getChar(stream, pos);
+        }
+
+        ret.type = Token::Number;
+        return ret;
+    }
+    else if (c == '{') {
+        return Token(Token::BeginBrace);
+    }
+    else if (c == '}') {
+        return Token(Token::EndBrace);
+    }
+    else if (c == '[') {
+        return Token(Token::BeginBracket);
+    }
+    else if (c == ']') {
+        return Token(Token::EndBracket);
+    }
+    else if (c == ',') {
+        return Token(Token::Coma);
+    }
+    else if (c == ':') {
+        return Token(Token::Colon);
+    }
+    else if (c == 'n') {
+        if (assertWord("ull")) {
+            return Token(Token::Null);
+        }
+        else {
+            JSON_THROW(
+                ParsingError(std::string{"unexpected token: "} + c, pos));
+        }
+    }
+    else if (c == 't') {
+        if (assertWord("rue")) {
+            ret.type = Token::BooleanTrue;
+            return ret;
+        }
+        else {
+            JSON_THROW(
+                ParsingError(std::string{"unexpected token: "} + c, pos));
+        }
+    }
+    else if (c == 'f') {
+        if (assertWord("alse")) {
+            ret.type = Token::BooleanFalse;
+            return ret;
+        }
+        else {
+            JSON_THROW(
+                ParsingError(std::string{"unexpected token: "} + c, pos));
+        }
+    }
+    else if (c == -1) {
+        // End of file probably because the file was empty
+        return Token(Token::None);
+    }
+    else {
+        JSON_THROW(
+            ParsingError(std::string{"unexpected character: "} + c, pos));
+    }
+    return Token(Token::None);
+}
+
+inline Json::RawToken Json::scanToken(BufferInput &input, Json::Position &pos) {
+    auto it = input.it;
+    const auto end = input.end;
+
+    it = Scan::whitespaceEnd(it, end);
+    advance(input, pos, input.it, it);
+
+    if (it == end) {
+        input.it = it;
+        return RawToken{Token::None};
+    }
+
+    const auto start = it;
+    const char c = *it++;
+
+    // Update the position to the current location and report the error
+    auto fail = [&](std::string info) {
+        advance(input, pos, start, it);
+        input.it = it;
+        reportError(input, std::move(info), pos);
+        return RawToken{Token::Error};
+    };
+
+    auto finish = [&](RawToken token) {
+        advance(input, pos, start, it);
+        input.it = it;
+        return token;
+    };
+
+    if (c == '"') {
+        auto ret = RawToken{Token::String};
+        for (;;) {
+            it = Scan::stringSpecial(it, end);
+            if (it == end) {
+                return fail("Unexpected end of file ");
+            }
+            auto special = *it++;
+            if (special == '"') {
+                break;
+            }
+            if (special != '\\') {
+                continue; // Control characters are accepted as is
+            }
+            if (it == end) {
+                return fail("Unexpected end of file ");
+            }
+            switch (*it++) {
+            case '"':
+            case 'b':
+            case 'r':
+            case 't':
+            case 'n':
+            case '\\':
+            case '/':
+            case 'f':
+            case 'u':
+                ret.escaped = true;
+                break;
+            default:
+                return fail("illegal character in string");
+            }
+        }
+        ret.text = std::string_view(start + 1, it - start - 2);
+        return finish(ret);
+    }
+
+    // Finish the token if the rest of the word matches
+    auto matchWord = [&](std::string_view word, Token::Type type) {
+        if (static_cast<size_t>(end - it) < word.size() ||
+            std::string_view{it, word.size()} != word) {
+            return fail(std::string{"unexpected token: "} + c);
+        }
+        it += word.size();
+        return finish(RawToken{type});
+    };
+
+    if (isdigit(static_cast<unsigned char>(c)) || c == '.' || c == '-') {
+        while (it != end && isNumberCharacter(*it)) {
+            ++it;
+        }
+        auto ret = RawToken{Token::Number};
+        ret.text = std::string_view(start, it - start);
+        return finish(ret);
+    }
+
+    switch (c) {
+    case '{':
+        return finish(RawToken{Token::BeginBrace});
+    case '}':
+        return finish(RawToken{Token::EndBrace});
+    case '[':
+        return finish(RawToken{Token::BeginBracket});
+    case ']':
+        return finish(RawToken{Token::EndBracket});
+    case ',':
+        return finish(RawToken{Token::Coma});
+    case ':':
+        return finish(RawToken{Token::Colon});
+    case 'n':
+        return matchWord("ull", Token::Null);
+    case 't':
+        return matchWord("rue", Token::BooleanTrue);
+    case 'f':
+        return matchWord("alse", Token::BooleanFalse);
+    }
+
+    return fail(std::string{"unexpected character: "} + c);
+}
+
+inline void Json::unescape(std::string_view raw, std::string &out) {
+    auto it = raw.data();
+    const auto end = it + raw.size();
+    for (;;) {
+        // Copy everything up to the next escape sequence in one go
+        auto next = static_cast<const char *>(std::memchr(it, '\\', end - it));
+        if (!next) {
+            out.append(it, end);
+            return;
+        }
+        out.append(it, next);
+        switch (next[1]) {
+        case '"':
+            out += '"';
+            break;
+        case 'b':
+            out += '\b';
+            break;
+        case 'r':
+            out += '\r';
+            break;
+        case 't':
+            out += '\t';
+            break;
+        case 'n':
+            out += '\n';
+            break;
+        case '\\':
+            out += '\\';
+            break;
+        case '/':
+            out += '/';
+            break;
+        case 'f':
+            out += '\f';
+            break;
+        case 'u':
+            out += "\\u";
+            break;
+        }
+        it = next + 2;
+    }
+}
+
+template <typename Input, typename Handler>
+inline bool Json::parseEvents(Input &input,
+                              Json::Position &pos,
+                              Handler &handler,
+                              const ParseOptions &options) {
+    if (pos == Position{1, 1}) {
+        removeBom(input);
+    }
+    if constexpr (std::is_same_v<Input, StreamInput>) {
+        return parseTokens(input, pos, handler, options);
+    }
+    else {
+        // Errors are stored while parsing and thrown here, unless the caller
+        // wants them stored
+        auto error = std::optional<ParsingError>{};
+        auto caller = input.error;
+        if (!caller) {
+            input.error = &error;
+        }
+        if (!options.positions) {
+            input.first = input.it;
+        }
+
+        auto result = parseTokens(input, pos, handler, options);
+
+        auto &stored = *input.error;
+        input.error = caller;
+        if (stored && input.first) {
+            // pos is still where parsing started
+            advance(pos, input.first, input.it);
+            stored = ParsingError(std::move(stored->info), pos);
+        }
+        if (stored && !caller) {
+            JSON_THROW(std::move(*stored));
+        }
+        return result;
+    }
+}
+
+template <typename Input, typename Handler>
+inline bool Json::parseTokens(Input &input,
+                              Json::Position &pos,
+                              Handler &handler,
+                              const ParseOptions &options) {
+    if constexpr (std::is_same_v<Input, StreamInput>) {
+        input.strict = options.strict;
+    }
+
+    // One entry for each open container, true for objects
+    auto stack = std::vector<bool>{};
+
+    // Buffer for strings that contains escape sequences
+    auto decoded = std::string{};
+
+    auto recorder = StatsRecorder<Input>{options, input};
+
+    auto scan = [&] {
+        auto start = recorder.now();
+        auto token = scanToken(input, pos);
+        recorder.tokenized(start);
+        return token;
+    };
+
+    // Report the error and stop parsing
+    auto fail = [&](std::string info) {
+        reportError(input, std::move(info), pos);
+        return false;
+    };
+
+    // Checks for ParseOptions::strict
+    auto allowed = [&](const RawToken &token) {
+        if (!options.strict) {
+            return true;
+        }
+        auto info = strictError(input, token);
+        return info.empty() || fail(std::move(info));
+    };
+
+    auto text = [&](const RawToken &token) {
+        recorder.string(token);
+        if (!Handler::decodeStrings || !token.escaped) {
+            return token.text;
+        }
+        auto start = recorder.now();
+        decoded.clear();
+        unescape(token.text, decoded);
+        recorder.decoded(start);
+        return std::string_view{decoded};
+    };
+
+    auto isClosing = [&stack](const RawToken &token) {
+        return token.type ==
+               (stack.back() ? Token::EndBrace : Token::EndBracket);
+    };
+
+    // Report the name of a member and read the following colon
+    auto name = [&](const RawToken &token) {
+        if (token.type != Token::String) {
+            return fail("unexpected token in object, expected name");
+        }
+        if (!allowed(token) || !handler.onKey(text(token))) {
+            return false;
+        }
+        auto colon = scan();
+        if (colon.type != Token::Colon) {
+            return fail("unexpexted token in object, expected ':' got " +
+                        std::string{colon.text});
+        }
+        return true;
+    };
+
+    // Called when the root value is finished
+    auto finish = [&] {
+        if (options.strict && !atEnd(input, pos)) {
+            return fail("unexpected data after value");
+        }
+        return true;
+    };
+
+    auto token = scan();
+    if (token.type == Token::None) {
+        if (options.strict) {
+            return fail("Unexpected end of file ");
+        }
+        return true; // Empty input
+    }
+
+    for (;;) {
+        // The token is the beginning of a value
+        auto opened = false;
+        auto proceed = true;
+
+        switch (token.type) {
+        case Token::String:
+            recorder.value(String, stack.size());
+            proceed = allowed(token) && handler.onString(text(token));
+            break;
+        case Token::Number: {
+            recorder.value(Number, stack.size());
+            recorder.number(token);
+            if (!allowed(token)) {
+                return false;
+            }
+            auto start = recorder.now();
+            auto number = NumberValue{};
+            if (!NumberValue::parse(token.text, number)) {
+                return fail("invalid number: " + std::string{token.text});
+            }
+            recorder.decoded(start);
+            proceed = handler.onNumber(number);
+            break;
+        }
+        case Token::Null:
+            recorder.value(Null, stack.size());
+            proceed = handler.onNull();
+            break;
+        case Token::BooleanTrue:
+        case Token::BooleanFalse:
+            recorder.value(Boolean, stack.size());
+            proceed = handler.onBool(token.type == Token::BooleanTrue);
+            break;
+        case Token::BeginBrace:
+        case Token::BeginBracket:
+            if (stack.size() >= options.maxDepth) {
+                return fail("maximum depth exceeded");
+            }
+            stack.push_back(token.type == Token::BeginBrace);
+            recorder.value(stack.back() ? Object : Array, stack.size());
+            proceed = stack.back() ? handler.onBeginObject()
+                                   : handler.onBeginArray();
+            opened = true;
+            break;
+        case Token::None:
+            return fail("Unexpected end of file ");
+        default:
+            return fail("unexpected token: " + std::string{token.text});
+        }
+
+        if (!proceed) {
+            return false;
+        }
+        if (stack.empty()) {
+            return finish(); // The root was not a object or array
+        }
+
+        token = scan();
+
+        if (opened && !isClosing(token)) {
+            if (stack.back()) {
+                if (!name(token)) {
+                    return false;
+                }
+                token = scan();
+            }
+            continue;
+        }
+
+        // The token is now either a coma or the end of one or more containers
+        for (;;) {
+            if (token.type == Token::Coma) {
+                token = scan();
+                if (stack.back()) {
+                    if (!name(token)) {
+                        return false;
+                    }
+                    token = scan();
+                }
+                break;
+            }
+            if (!isClosing(token)) {
+                return fail(token.type == Token::None
+                                ? "Unexpected end of file "
+                                : "unexpected character in array: " +
+                                      std::string{token.text});
+            }
+            auto isObject = stack.back();
+            stack.pop_back();
+            recorder.close();
+            if (!(isObject ? handler.onEndObject() : handler.onEndArray())) {
+                return false;
+            }
+            if (stack.empty()) {
+                return finish();
+            }
+            token = scan();
+        }
+    }
+}
+
+struct Json::Validator : public EventHandler {
+    static constexpr bool decodeStrings = false;
+};
+
+inline bool Json::isStrictNumber(std::string_view text) {
+    auto it = text.data();
+    auto end = it + text.size();
+
+    // -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+    auto digits = [&] {
+        auto start = it;
+        while (it != end && *it >= '0' && *it <= '9') {
+            ++it;
+        }
+        return it != start;
+    };
+    if (it != end && *it == '-') {
+        ++it;
+    }
+    if (it != end && *it == '0') {
+        ++it;
+    }
+    else if (!digits()) {
+        return false;
+    }
+    if (it != end && *it == '.') {
+        ++it;
+        if (!digits()) {
+            return false;
+        }
+    }
+    if (it != end && (*it == 'e' || *it == 'E')) {
+        ++it;
+        if (it != end && (*it == '+' || *it == '-')) {
+            ++it;
+        }
+        if (!digits()) {
+            return false;
+        }
+    }
+    return it == end;
+}
+
+inline std::string Json::strictError(BufferInput &, const RawToken &token) {
+    if (token.type == Token::Number) {
+        if (!isStrictNumber(token.text)) {
+            return "invalid number: " + std::string{token.text};
+        }
+        return {};
+    }
+
+    auto it = token.text.data();
+    auto end = it + token.text.size();
+
+    // Other escape sequences are already checked by scanToken
+    for (it = Scan::stringSpecial(it, end); it != end;
+         it = Scan::stringSpecial(it, end)) {
+        if (*it != '\\') {
+            return "control character in string";
+        }
+        if (it[1] == 'u') {
+            for (int i = 2; i < 6; ++i) {
+                if (it + i >= end ||
+                    !std::isxdigit(static_cast<unsigned char>(it[i]))) {
+                    return "expected four hex digits after \\u";
+                }
+            }
+        }
+        it += 2;
+    }
+    return {};
+}
+
+inline std::optional<Json::ParsingError> Json::Validate(std::string_view str,
+                                                        ParseOptions options) {
+    options.strict = true;
+    options.positions = false;
+    auto error = std::optional<ParsingError>{};
+    auto input = BufferInput{str.data(), str.data() + str.size()};
+    input.error = &error;
+    Position pos;
+    auto validator = Validator{};
+    parseEvents(input, pos, validator, options);
+    return error;
+}
+
+inline std::optional<Json::ParsingError> Json::Validate(std::istream &stream,
+                                                        ParseOptions options) {
+    // The stream parser allocates each token and throws on errors
+    auto text = std::string{std::istreambuf_iterator<char>{stream}, {}};
+    return Validate(text, options);
+}
+
+struct Json::TreeBuilder : public EventHandler {
+    Json &root;
+    const Position &pos;
+
+    // Objects and arrays that are not finished, children are added at the back
+    std::vector<Json *> stack = {};
+
+    // True when the last child of the innermost object has a name but no value
+    bool named = false;
+
+    //! Get the node that the next value should be written to
+    Json &target() {
+        if (named) {
+            named = false;
+            return stack.back()->back();
+        }
+        if (stack.empty()) {
+            return root;
+        }
+        return stack.back()->emplace_back();
+    }
+
+    Json &set(Type type) {
+        auto &json = target();
+        json.type = type;
+        json.pos = pos;
+        return json;
+    }
+
+    bool onNull() {
+        set(Null);
+        return true;
+    }
+
+    bool onBool(bool value) {
+        set(Boolean).value = value ? "true" : "false";
+        return true;
+    }
+
+    bool onNumber(NumberValue value) {
+        set(Number).numberValue = value;
+        return true;
+    }
+
+    bool onString(std::string_view value) {
+        set(String).value = value;
+        return true;
+    }
+
+    bool onBeginObject() {
+        stack.push_back(&set(Object));
+        return true;
+    }
+
+    bool onKey(std::string_view name) {
+        stack.back()->emplace_back().name = name;
+        named = true;
+        return true;
+    }
+
+    bool onEndObject() {
+        stack.pop_back();
+        return true;
+    }
+
+    bool onBeginArray() {
+        stack.push_back(&set(Array));
+        return true;
+    }
+
+    bool onEndArray() {
+        stack.pop_back();
+        return true;
+    }
+};
+
+//! Parser that is given the input in parts as it arrives, for example from
+//! a socket. Complete tokens are parsed directly and only an unfinished token
+//! at the end of a part is kept until the next part.
+//!
+//! auto parser = Json::IncrementalParser{};
+//! while (parser.status() == Json::IncrementalParser::NeedMore) {
+//!     auto size = receive(buffer);
+//!     size ? parser.feed(buffer, size) : parser.finish();
+//! }
+//! auto json = parser.take(); // Throws the error if there was one
+class Json::IncrementalParser {
+public:
+    enum Status {
+        NeedMore,
+        Complete,
+        Error,
+    };
+
+    IncrementalParser(ParseOptions options = {}) : options(options) {}
+
+    // The tree builder refers to members
+    IncrementalParser(const IncrementalParser &) = delete;
+    IncrementalParser &operator=(const IncrementalParser &) = delete;
+
+    //! Parse the next part of the input
+    //! Whitespace is allowed after the value, anything else is an error
+    Status feed(const char *data, size_t size);
+
+    Status feed(std::string_view data) {
+        return feed(data.data(), data.size());
+    }
+
+    //! Tell that there is no more input
+    //! Only needed when the value can be unfinished, like a number at the root
+    Status finish();
+
+    Status status() const {
+        return current;
+    }
+
+    //! @return the error or nullptr when status is not Error
+    const ParsingError *error() const {
+        return failure ? &*failure : nullptr;
+    }
+
+    //! Move the parsed value out of the parser
+    //! @throw ParsingError if there was an error or the value is not complete
+    Json take();
+
+    //! Start over with a new value
+    void reset();
+
+private:
+    //! What the next token is allowed to be
+    enum Expect {
+        Value,
+        ValueOrEnd, // After '['
+        Name,
+        NameOrEnd, // After '{'
+        Colon,
+        ComaOrEnd,
+        Nothing, // After the root value
+    };
+
+    //! Parse all complete tokens in [first, last)
+    //! @param final if the input ends at last
+    //! @return pointer to the first byte that is not used
+    const char *parse(const char *first, const char *last, bool final);
+
+    //! Find the end of the token that begins at first without validating it
+    //! @return nullptr if the token does not end before last
+    const char *tokenEnd(const char *first, const char *last, bool final);
+
+    void process(const RawToken &token);
+    void value(const RawToken &token);
+    void close();
+
+    //! Checks for ParseOptions::strict on names, strings and numbers
+    void checkStrict(const RawToken &token) {
+        if (!options.strict) {
+            return;
+        }
+        auto input = BufferInput{token.text.data(),
+                                 token.text.data() + token.text.size()};
+        auto info = strictError(input, token);
+        if (!info.empty()) {
+            JSON_THROW(ParsingError(std::move(info), pos));
+        }
+    }
+
+    std::string_view text(const RawToken &token) {
+        if (!token.escaped) {
+            return token.text;
+        }
+        decoded.clear();
+        unescape(token.text, decoded);
+        return decoded;
+    }
+
+    void afterValue() {
+        expect = builder.stack.empty() ? Nothing : ComaOrEnd;
+        if (expect == Nothing) {
+            current = Complete;
+        }
+    }
+
+    ParseOptions options;
+    Json root = {};
+    Position pos = {};
+    TreeBuilder builder = TreeBuilder{{}, root, pos};
+    Expect expect = Value;
+    Status current = NeedMore;
+    std::optional<ParsingError> failure = {};
+    std::string pending = {};  // Unfinished token from the previous part
+    size_t stringChecked = 0; // Bytes of a pending string that are checked
+    std::string decoded = {};
+    bool started = false; // Set when a byte order mark can not follow
+};
+
+inline Json &Json::parse(std::istream &ss, ParseOptions options) {
+    clear();
+    value.clear();
+    type = None;
+    auto input = StreamInput{ss};
+    Position pos;
+    auto builder = TreeBuilder{{}, *this, pos};
+    parseEvents(input, pos, builder, options);
+    return *this;
+}
+
+inline Json &Json::parse(std::string_view str, ParseOptions options) {
+    clear();
+    value.clear();
+    type = None;
+    auto input = BufferInput{str.data(), str.data() + str.size()};
+    Position pos;
+    auto builder = TreeBuilder{{}, *this, pos};
+    parseEvents(input, pos, builder, options);
+    return *this;
+}
+
+inline std::optional<Json::ParsingError> Json::tryParse(std::string_view str,
+                                                        ParseOptions options) {
+    clear();
+    value.clear();
+    type = None;
+    auto error = std::optional<ParsingError>{};
+    auto input = BufferInput{str.data(), str.data() + str.size()};
+    input.error = &error;
+    Position pos;
+    auto builder = TreeBuilder{{}, *this, pos};
+    parseEvents(input, pos, builder, options);
+    return error;
+}
+
+inline void Json::escapeString(std::ostream &stream, std::string_view str) {
+    auto sink = StreamSink{stream};
+    Writer<StreamSink>{sink}.writeString(str);
+}
+
+inline std::string Json::stringify(int indent) const {
+    auto out = std::string{};
+    stringify(out, indent);
+    return out;
+}
+
+inline void Json::stringify(std::string &out, int indent) const {
+    Writer<std::string>{out, indent}.write(*this);
+}
+
+inline size_t Json::stringifiedSize(int indent) const {
+    auto sink = SizeSink{};
+    Writer<SizeSink>{sink, indent}.write(*this);
+    return sink.size;
+}
+
+inline void Json::stringify(std::ostream &stream,
+                            int indent,
+                            int startIndent) const {
+    auto sink = StreamSink{stream};
+    Writer<StreamSink>{sink, indent, startIndent}.write(*this);
+}
+
+template <typename Sink>
+inline void Json::Writer<Sink>::writeString(std::string_view str) {
+    append("\"");
+    auto it = str.data();
+    const auto end = it + str.size();
+    for (;;) {
+        // Write everything that does not need escaping in one go
+        auto next = Scan::stringSpecial(it, end);
+        sink.append(it, static_cast<size_t>(next - it));
+        if (next == end) {
+            break;
+        }
+        switch (*next) {
+        case '\n':
+            append("\\n");
+            break;
+        case '\r':
+            append("\\r");
+            break;
+        case '\t':
+            append("\\t");
+            break;
+        case '\f':
+            append("\\f");
+            break;
+        case '\b':
+            append("\\b");
+            break;
+        case '"':
+            append("\\\"");
+            break;
+        case '\\':
+            append("\\\\");
+            break;
+        default:
+            sink.append(next, 1);
+        }
+        it = next + 1;
+    }
+    append("\"");
+}
+
+template <typename Sink>
+inline void Json::Writer<Sink>::newline() {
+    if (indent < 0) {
+        return;
+    }
+    auto size = static_cast<size_t>(level * indent) + 1;
+    if (newlines.size() < size) {
+        newlines.resize(size, ' ');
+    }
+    sink.append(newlines.data(), size);
+}
+
+template <typename Sink>
+inline void Json::Writer<Sink>::beginChild(bool first,
+                                           bool isObject,
+                                           std::string_view name) {
+    if (!first) {
+        append(",");
+    }
+    newline();
+    if (isObject) {
+        writeString(name);
+        append(indent < 0 ? ":" : ": ");
+    }
+}
+
+template <typename Sink>
+inline void Json::Writer<Sink>::write(const Json &json) {
+    switch (json.type) {
+    case Number:
+        writeNumber(json.numberValue);
+        break;
+    case String:
+        writeString(json.value);
+        break;
+    case Null:
+        append("null");
+        break;
+    case Boolean:
+        append(json.value);
+        break;
+    case Object:
+    case Array: {
+        auto isObject = json.type == Object;
+        if (json.empty()) {
+            append(isObject ? "{}" : "[]");
+            break;
+        }
+        append(isObject ? "{" : "[");
+        ++level;
+        writeChildren(json, 0, json.size());
+        --level;
+        newline();
+        append(isObject ? "}" : "]");
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+template <typename Sink>
+inline void Json::Writer<Sink>::write(ConstRef ref) {
+    switch (ref.type()) {
+    case Number:
+        writeNumber(ref.number());
+        break;
+    case String:
+        writeString(ref.string());
+        break;
+    case Null:
+        append("null");
+        break;
+    case Boolean:
+        append(ref.boolean() ? "true" : "false");
+        break;
+    case Object:
+    case Array: {
+        auto isObject = ref.type() == Object;
+        if (ref.empty()) {
+            append(isObject ? "{}" : "[]");
+            break;
+        }
+        append(isObject ? "{" : "[");
+        ++level;
+        auto first = true;
+        for (auto child : ref) {
+            beginChild(first, isObject, child.name());
+            first = false;
+            write(child);
+        }
+        --level;
+        newline();
+        append(isObject ? "}" : "]");
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+template <typename Sink>
+template <typename T>
+inline void Json::Writer<Sink>::writeValue(const T &value) {
+    if constexpr (std::is_same_v<T, bool>) {
+        append(value ? "true" : "false");
+    }
+    else if constexpr (std::is_arithmetic_v<T>) {
+        writeNumber(NumberValue{value});
+    }
+    else if constexpr (std::is_same_v<T, std::string>) {
+        writeString(value);
+    }
+    else if constexpr (IsOptional<T>::value) {
+        if (value) {
+            writeValue(*value);
+        }
+        else {
+            append("null");
+        }
+    }
+    else if constexpr (IsVector<T>::value) {
+        if (value.empty()) {
+            append("[]");
+            return;
+        }
+        append("[");
+        ++level;
+        for (size_t i = 0; i < value.size(); ++i) {
+            beginChild(i == 0, false, {});
+            writeValue(value[i]);
+        }
+        --level;
+        newline();
+        append("]");
+    }
+    else if constexpr (HasFields<T>::value) {
+        append("{");
+        ++level;
+        auto first = true;
+        std::apply(
+            [&](auto &...field) {
+                auto write = [&](auto &field) {
+                    auto &member = value.*(field.member);
+                    if constexpr (IsOptional<
+                                      std::decay_t<decltype(member)>>::value) {
+                        if (!member) {
+                            return;
+                        }
+                    }
+                    beginChild(first, true, field.name);
+                    first = false;
+                    writeValue(member);
+                };
+                (write(field), ...);
+            },
+            FieldTable<T>::fields);
+        --level;
+        if (first) {
+            append("}"); // Written as "{}" when empty
+            return;
+        }
+        newline();
+        append("}");
+    }
+    else {
+        static_assert(IsVector<T>::value, // Always false
+                      "Type is not supported, add JSON_FIELDS for structs");
+    }
+}
+
+//! Handler that appends nodes to a document
+struct Json::Document::Builder : public EventHandler {
+    std::vector<Node> &nodes;
+    std::string &strings;
+
+    // Strings inside this range are referred to instead of copied
+    std::string_view mapped = {};
+
+    // Set when names are interned, see Document::names
+    std::vector<uint32_t> *names = nullptr;
+    size_t nameCount = 0;
+
+    struct Open {
+        size_t index;
+        uint32_t count;
+    };
+    std::vector<Open> stack = {};
+
+    void add(Node node) {
+        if (!stack.empty()) {
+            ++stack.back().count;
+        }
+        nodes.push_back(node);
+    }
+
+    void addString(std::string_view value) {
+        auto node = Node{String};
+        node.size = static_cast<uint32_t>(value.size());
+        // Strings without escape sequences points into the parsed text
+        auto less = std::less_equal<const char *>{};
+        if (!mapped.empty() && less(mapped.data(), value.data()) &&
+            less(value.data() + value.size(), mapped.data() + mapped.size())) {
+            node.offset = mappedBit | static_cast<uint64_t>(value.data() -
+                                                             mapped.data());
+        }
+        else {
+            node.offset = strings.size();
+            strings.append(value);
+        }
+        nodes.push_back(node);
+    }
+
+    std::string_view text(const Node &node) const {
+        auto data = (node.offset & mappedBit)
+                        ? mapped.data() + (node.offset & ~mappedBit)
+                        : strings.data() + node.offset;
+        return {data, node.size};
+    }
+
+    //! Add a name that refers to the same string as earlier equal names
+    void addName(std::string_view name) {
+        auto &slots = *names;
+        if (nameCount * 2 >= slots.size()) {
+            // Grow and reinsert, load factor is kept below 0.5
+            auto old = std::move(slots);
+            slots.assign(std::max<size_t>(64, old.size() * 2), 0);
+            for (auto index : old) {
+                if (index) {
+                    insert(text(nodes[index - 1]), index);
+                }
+            }
+        }
+        auto &first = insert(name, static_cast<uint32_t>(nodes.size() + 1));
+        if (first == nodes.size() + 1) {
+            ++nameCount;
+            addString(name);
+        }
+        else {
+            nodes.push_back(nodes[first - 1]);
+        }
+    }
+
+    //! @return the slot with name, that is set to index if it was empty
+    uint32_t &insert(std::string_view name, uint32_t index) {
+        auto &slots = *names;
+        const auto mask = slots.size() - 1;
+        for (auto i = hashKey(name) & mask;; i = (i + 1) & mask) {
+            if (!slots[i]) {
+                slots[i] = index;
+                return slots[i];
+            }
+            if (text(nodes[slots[i] - 1]) == name) {
+                return slots[i];
+            }
+        }
+    }
+
+    void close() {
+        auto &node = nodes[stack.back().index];
+        node.size = stack.back().count;
+        node.end = nodes.size();
+        stack.pop_back();
+    }
+
+    bool onNull() {
+        add(Node{Null});
+        return true;
+    }
+
+    bool onBool(bool value) {
+        auto node = Node{Boolean};
+        node.integer = value;
+        add(node);
+        return true;
+    }
+
+    bool onNumber(NumberValue value) {
+        auto node = Node{Number, value.kind};
+        node.unsignedInteger = value.unsignedInteger;
+        add(node);
+        return true;
+    }
+
+    bool onString(std::string_view value) {
+        if (!stack.empty()) {
+            ++stack.back().count;
+        }
+        addString(value);
+        return true;
+    }
+
+    bool onBeginObject() {
+        add(Node{Object});
+        stack.push_back({nodes.size() - 1, 0});
+        return true;
+    }
+
+    bool onKey(std::string_view name) {
+        if (names) {
+            addName(name);
+        }
+        else {
+            addString(name);
+        }
+        return true;
+    }
+
+    bool onEndObject() {
+        close();
+        return true;
+    }
+
+    bool onBeginArray() {
+        add(Node{Array});
+        stack.push_back({nodes.size() - 1, 0});
+        return true;
+    }
+
+    bool onEndArray() {
+        close();
+        return true;
+    }
+};
+
+inline Json::Document Json::Document::Parse(std::string_view str,
+                                            ParseOptions options) {
+    return parse(str, options, nullptr);
+}
+
+inline Json::Document Json::Document::LoadFile(const std::string &fname,
+                                               ParseOptions options) {
+    return Parse(FileMapping{fname}.view(), options);
+}
+
+inline Json::Document Json::Document::MapFile(const std::string &fname,
+                                              ParseOptions options) {
+    auto file = std::make_shared<const FileMapping>(fname);
+    return parse(file->view(), options, file);
+}
+
+inline Json::Document Json::Document::parse(
+    std::string_view str,
+    ParseOptions options,
+    std::shared_ptr<const FileMapping> file) {
+    auto document = Document{};
+    document.nodes.clear();
+    document.nodes.reserve(str.size() / 16 + 1);
+
+    auto builder = Builder{{}, document.nodes, document.strings};
+    if (file) {
+        builder.mapped = str;
+        document.file = std::move(file);
+    }
+    if (options.internNames) {
+        builder.names = &document.names;
+    }
+    options.positions = false;
+    ParseEvents(str, builder, options);
+
+    if (document.nodes.empty()) {
+        document.nodes.emplace_back(); // Empty input
+    }
+
+    document.nodes.shrink_to_fit();
+    document.strings.shrink_to_fit();
+    return document;
+}
+
+inline std::string_view Json::Document::text(const Node &node) const {
+    auto data = (node.offset & mappedBit)
+                    ? file->view().data() + (node.offset & ~mappedBit)
+                    : strings.data() + node.offset;
+    return {data, node.size};
+}
+
+inline size_t Json::Document::findName(std::string_view name) const {
+    const auto mask = names.size() - 1;
+    for (auto i = hashKey(name) & mask; names[i]; i = (i + 1) & mask) {
+        if (text(nodes[names[i] - 1]) == name) {
+            return names[i];
+        }
+    }
+    return 0;
+}
+
+inline Json::ConstRef::iterator &Json::ConstRef::iterator::operator++() {
+    auto &node = document->nodes[index];
+    index = (node.type == Object || node.type == Array) ? node.end : index + 1;
+    if (named) {
+        ++index; // Skip the name of the next member
+    }
+    return *this;
+}
+
+inline Json::Type Json::ConstRef::type() const {
+    return static_cast<Type>(document->nodes[index].type);
+}
+
+inline std::string_view Json::ConstRef::name() const {
+    if (!named) {
+        return {};
+    }
+    auto &node = document->nodes[index - 1];
+    return document->text(node);
+}
+
+inline std::string_view Json::ConstRef::string() const {
+    auto &node = document->nodes[index];
+    if (node.type != String) {
+        JSON_THROW(std::runtime_error("Type in json is not string"));
+    }
+    return document->text(node);
+}
+
+inline bool Json::ConstRef::boolean() const {
+    auto &node = document->nodes[index];
+    if (node.type != Boolean) {
+        JSON_THROW(std::runtime_error("Type in json is not boolean"));
+    }
+    return node.integer;
+}
+
+inline Json::NumberValue Json::ConstRef::number() const {
+    auto &node = document->nodes[index];
+    if (node.type != Number) {
+        JSON_THROW(std::runtime_error("Type in json is not number"));
+    }
+    auto ret = NumberValue{};
+    ret.kind = node.kind;
+    ret.unsignedInteger = node.unsignedInteger;
+    return ret;
+}
+
+inline size_t Json::ConstRef::size() const {
+    auto &node = document->nodes[index];
+    return (node.type == Object || node.type == Array) ? node.size : 0;
+}
+
+inline Json::ConstRef::iterator Json::ConstRef::begin() const {
+    auto isObject = type() == Object;
+    if (!isObject && type() != Array) {
+        return end();
+    }
+    return iterator{document, index + (isObject ? 2 : 1), isObject};
+}
+
+inline Json::ConstRef::iterator Json::ConstRef::end() const {
+    auto &node = document->nodes[index];
+    auto isObject = type() == Object;
+    if (!isObject && type() != Array) {
+        return iterator{document, index + 1, false};
+    }
+    return iterator{document, node.end + (isObject ? 1 : 0), isObject};
+}
+
+inline Json::ConstRef::iterator Json::ConstRef::find(
+    std::string_view name) const {
+    if (type() != Object) {
+        return end();
+    }
+    if (!document->names.empty()) {
+        // Interned names are equal if they refer to the same string
+        auto first = document->findName(name);
+        if (!first) {
+            return end();
+        }
+        auto offset = document->nodes[first - 1].offset;
+        for (auto it = begin(), e = end(); it != e; ++it) {
+            if (document->nodes[(*it).index - 1].offset == offset) {
+                return it;
+            }
+        }
+        return end();
+    }
+    for (auto it = begin(), e = end(); it != e; ++it) {
+        if ((*it).name() == name) {
+            return it;
+        }
+    }
+    return end();
+}
+
+inline Json::ConstRef Json::ConstRef::operator[](std::string_view name) const {
+    auto f = find(name);
+    if (f == end()) {
+        JSON_THROW(std::out_of_range("could not find " + std::string{name} +
+                                     " in json"));
+    }
+    return *f;
+}
+
+inline Json::ConstRef Json::ConstRef::operator[](int index) const {
+    if (index < 0 || static_cast<size_t>(index) >= size()) {
+        JSON_THROW(std::out_of_range("index out of range in json"));
+    }
+    auto it = begin();
+    for (int i = 0; i < index; ++i) {
+        ++it;
+    }
+    return *it;
+}
+
+inline Json Json::ConstRef::toJson() const {
+    auto json = Json{type()};
+    switch (type()) {
+    case String:
+        json.value = string();
+        break;
+    case Number:
+        json.numberValue = number();
+        break;
+    case Boolean:
+        json.value = boolean() ? "true" : "false";
+        break;
+    case Object:
+    case Array:
+        json.reserve(size());
+        for (auto child : *this) {
+            json.push_back(child.toJson());
+            json.back().name = child.name();
+        }
+        break;
+    default:
+        break;
+    }
+    return json;
+}
+
+inline std::string Json::ConstRef::stringify(int indent) const {
+    auto out = std::string{};
+    stringify(out, indent);
+    return out;
+}
+
+inline void Json::ConstRef::stringify(std::string &out, int indent) const {
+    Writer<std::string>{out, indent}.write(*this);
+}
+
+inline void Json::ConstRef::stringify(std::ostream &stream,
+                                      int indent,
+                                      int startIndent) const {
+    auto sink = StreamSink{stream};
+    Writer<StreamSink>{sink, indent, startIndent}.write(*this);
+}
+
+inline Json::Lazy Json::ParseLazy(std::string_view str, ParseOptions options) {
+    auto input = BufferInput{str.data(), str.data() + str.size()};
+    removeBom(input);
+    auto root = Lazy{input.it, input.end, options.maxDepth};
+    auto it = Scan::whitespaceEnd(input.it, input.end);
+    if (it == input.end) {
+        return root; // Empty input
+    }
+    return root.value(it, 0);
+}
+
+inline Json::RawToken Json::Lazy::scan(BufferInput &input) const {
+    // Positions are calculated from the beginning of the document on errors
+    auto pos = Position{};
+    auto error = std::optional<ParsingError>{};
+    input.first = first;
+    input.error = &error;
+    auto token = scanToken(input, pos);
+    input.error = nullptr;
+    if (error) {
+        fail(std::move(error->info), input.it);
+    }
+    return token;
+}
+
+inline Json::Lazy Json::Lazy::value(const char *from, size_t depth) const {
+    auto input = BufferInput{from, last};
+    auto token = scan(input);
+    switch (token.type) {
+    case Token::BeginBrace:
+    case Token::BeginBracket:
+        if (depth >= maxDepth) {
+            fail("maximum depth exceeded", input.it);
+        }
+        [[fallthrough]];
+    case Token::String:
+    case Token::Number:
+    case Token::Null:
+    case Token::BooleanTrue:
+    case Token::BooleanFalse:
+        break;
+    case Token::None:
+        fail("Unexpected end of file ", input.it);
+    default:
+        fail("unexpected token: " + std::string{token.text}, input.it);
+    }
+
+    auto ret = Lazy{first, last, maxDepth};
+    ret.it = Scan::whitespaceEnd(from, last);
+    ret.next = input.it;
+    ret.depth = depth;
+    return ret;
+}
+
+inline Json::Lazy Json::Lazy::member(const char *from,
+                                     bool isObject,
+                                     size_t depth) const {
+    if (!isObject) {
+        return value(from, depth);
+    }
+    auto input = BufferInput{from, last};
+    auto name = scan(input);
+    if (name.type != Token::String) {
+        fail("unexpected token in object, expected name", input.it);
+    }
+    auto colon = scan(input);
+    if (colon.type != Token::Colon) {
+        fail("unexpexted token in object, expected ':' got " +
+                 std::string{colon.text},
+             input.it);
+    }
+    auto ret = value(input.it, depth);
+    ret.rawName = name.text;
+    ret.escapedName = name.escaped;
+    return ret;
+}
+
+inline const char *Json::Lazy::skipContainer(const char *from) const {
+    // The closing bracket expected for each open container
+    auto stack = std::string{*it == '{' ? '}' : ']'};
+    auto p = from;
+    for (;;) {
+        p = Scan::bracketOrQuote(p, last);
+        if (p == last) {
+            fail("Unexpected end of file ", last);
+        }
+        auto c = *p++;
+        switch (c) {
+        case '"':
+            // Find the end of the string and check escape sequences
+            for (;;) {
+                p = Scan::stringSpecial(p, last);
+                if (p == last) {
+                    fail("Unexpected end of file ", last);
+                }
+                auto special = *p++;
+                if (special == '"') {
+                    break;
+                }
+                if (special != '\\') {
+                    continue;
+                }
+                if (p == last) {
+                    fail("Unexpected end of file ", last);
+                }
+                switch (*p++) {
+                case '"':
+                case '/':
+                case 'b':
+                case 'r':
+                case 't':
+                case 'n':
+                case '\\':
+                case 'f':
+                case 'u':
+                    break;
+                default:
+                    fail("illegal character in string", p);
+                }
+            }
+            break;
+        case '{':
+        case '[':
+            if (depth + stack.size() >= maxDepth) {
+                fail("maximum depth exceeded", p);
+            }
+            stack += c == '{' ? '}' : ']';
+            break;
+        default:
+            if (c != stack.back()) {
+                fail("unexpected character in array: ", p);
+            }
+            stack.pop_back();
+            if (stack.empty()) {
+                return p;
+            }
+        }
+    }
+}
+
+inline Json::Lazy::iterator &Json::Lazy::iterator::operator++() {
+    auto input = BufferInput{current.skip(), current.last};
+    auto token = current.scan(input);
+    if (token.type == Token::Coma) {
+        current = current.member(input.it, isObject, current.depth);
+        return *this;
+    }
+    if (token.type != (isObject ? Token::EndBrace : Token::EndBracket)) {
+        current.fail(token.type == Token::None
+                         ? "Unexpected end of file "
+                         : "unexpected character in array: " +
+                               std::string{token.text},
+                     input.it);
+    }
+    current.it = nullptr;
+    return *this;
+}
+
+inline Json::Type Json::Lazy::type() const {
+    if (it == last) {
+        return None;
+    }
+    switch (*it) {
+    case '{':
+        return Object;
+    case '[':
+        return Array;
+    case '"':
+        return String;
+    case 'n':
+        return Null;
+    case 't':
+    case 'f':
+        return Boolean;
+    default:
+        return Number;
+    }
+}
+
+inline std::string Json::Lazy::name() const {
+    if (!escapedName) {
+        return std::string{rawName};
+    }
+    auto ret = std::string{};
+    unescape(rawName, ret);
+    return ret;
+}
+
+inline std::string Json::Lazy::string() const {
+    if (type() != String) {
+        JSON_THROW(std::runtime_error("Type in json is not string"));
+    }
+    auto text = std::string_view{it + 1, static_cast<size_t>(next - it - 2)};
+    auto ret = std::string{};
+    unescape(text, ret);
+    return ret;
+}
+
+inline bool Json::Lazy::boolean() const {
+    if (type() != Boolean) {
+        JSON_THROW(std::runtime_error("Type in json is not boolean"));
+    }
+    return *it == 't';
+}
+
+inline Json::NumberValue Json::Lazy::number() const {
+    if (type() != Number) {
+        JSON_THROW(std::runtime_error("Type in json is not number"));
+    }
+    auto text = std::string_view{it, static_cast<size_t>(next - it)};
+    auto ret = NumberValue{};
+    if (!NumberValue::parse(text, ret)) {
+        fail("invalid number: " + std::string{text}, next);
+    }
+    return ret;
+}
+
+inline size_t Json::Lazy::size() const {
+    return static_cast<size_t>(std::distance(begin(), end()));
+}
+
+inline bool Json::Lazy::empty() const {
+    return begin() == end();
+}
+
+inline Json::Lazy::iterator Json::Lazy::begin() const {
+    auto isObject = type() == Object;
+    if (!isObject && type() != Array) {
+        return end();
+    }
+    auto input = BufferInput{next, last};
+    auto token = scan(input);
+    if (token.type == (isObject ? Token::EndBrace : Token::EndBracket)) {
+        return end();
+    }
+    return iterator{member(next, isObject, depth + 1), isObject};
+}
+
+inline Json::Lazy::iterator Json::Lazy::end() const {
+    auto ret = Lazy{first, last, maxDepth};
+    ret.it = nullptr;
+    return iterator{ret, type() == Object};
+}
+
+inline Json::Lazy::iterator Json::Lazy::find(std::string_view name) const {
+    if (type() != Object) {
+        return end();
+    }
+    auto decoded = std::string{};
+    for (auto i = begin(), e = end(); i != e; ++i) {
+        if (i->hasName(name, decoded)) {
+            return i;
+        }
+    }
+    return end();
+}
+
+inline Json::Lazy Json::Lazy::operator[](std::string_view name) const {
+    auto f = find(name);
+    if (f == end()) {
+        JSON_THROW(std::out_of_range("could not find " + std::string{name} +
+                                     " in json"));
+    }
+    return *f;
+}
 
-/// Definition of internal functions-------------------------------------------
+inline Json::Lazy Json::Lazy::operator[](int index) const {
+    if (index >= 0) {
+        auto i = begin();
+        for (auto e = end(); i != e; ++i, --index) {
+            if (!index) {
+                return *i;
+            }
+        }
+    }
+    JSON_THROW(std::out_of_range("index out of range in json"));
+}
 
-inline char Json::getChar(std::istream &stream, Json::Position &pos) {
-    if (stream.eof()) {
-        throw ParsingError("Unexpected end of file ", pos);
+inline Json::IncrementalParser::Status Json::IncrementalParser::feed(
+    const char *data, size_t size) {
+    if (current == Error) {
+        return current;
     }
-    auto c = stream.get();
-    if (c == '\n') {
-        pos.col = 1;
-        ++pos.line;
+    JSON_TRY {
+        if (pending.empty()) {
+            auto used = parse(data, data + size, false);
+            pending.assign(used, data + size);
+        }
+        else {
+            pending.append(data, size);
+            auto first = pending.data();
+            auto used = parse(first, first + pending.size(), false);
+            pending.erase(0, static_cast<size_t>(used - first));
+        }
     }
-    else {
-        ++pos.col;
+    JSON_CATCH(ParsingError, e) {
+        failure = std::move(e);
+        current = Error;
     }
-    return c;
+    return current;
 }
 
-inline Json::Token Json::getNextToken(std::istream &stream,
-                                      Json::Position &pos) {
-    Token ret;
+inline Json::IncrementalParser::Status Json::IncrementalParser::finish() {
+    if (current == Error) {
+        return current;
+    }
+    JSON_TRY {
+        auto first = pending.data();
+        parse(first, first + pending.size(), true);
+        pending.clear();
+        if (current != Complete) {
+            JSON_THROW(ParsingError("Unexpected end of file ", pos));
+        }
+    }
+    JSON_CATCH(ParsingError, e) {
+        failure = std::move(e);
+        current = Error;
+    }
+    return current;
+}
 
-    if (stream.eof()) {
-        throw ParsingError("End of file when expecting character", pos);
+inline Json Json::IncrementalParser::take() {
+    if (failure) {
+        JSON_THROW(*failure);
     }
-    char c = getChar(stream, pos);
+    if (current != Complete) {
+        JSON_THROW(ParsingError("Unexpected end of file ", pos));
+    }
+    auto ret = std::move(root);
+    reset();
+    return ret;
+}
 
-    while (isspace(c)) {
-        c = getChar(stream, pos);
-        if (stream.eof()) {
-            throw ParsingError("End of file when expecting character", pos);
+inline void Json::IncrementalParser::reset() {
+    root = Json{};
+    pos = {};
+    builder.stack.clear();
+    builder.named = false;
+    expect = Value;
+    current = NeedMore;
+    failure.reset();
+    pending.clear();
+    stringChecked = 0;
+    started = false;
+}
+
+inline const char *Json::IncrementalParser::parse(const char *first,
+                                                  const char *last,
+                                                  bool final) {
+    if (!started) {
+        auto size = std::min<size_t>(3, static_cast<size_t>(last - first));
+        if (!final && size < 3 &&
+            (!size || std::memcmp(first, "\xef\xbb\xbf", size) == 0)) {
+            return first; // Could be the beginning of a byte order mark
         }
+        auto input = BufferInput{first, last};
+        removeBom(input);
+        first = input.it;
+        started = true;
     }
 
-    if (c == '"') {
-        ret.type = Token::String;
-        c = getChar(stream, pos);
-        while (c != '"') {
-            if (c == '\\') {
-                c = getChar(stream, pos);
-                switch (c) {
-                case '"':
-                    ret.value += c;
-                    break;
-                case 'b':
-                    ret.value += '\b';
-                    break;
-                case 'r':
-                    ret.value += '\r';
-                    break;
-                case 't':
-                    ret.value += '\t';
-                    break;
-                case 'n':
-                    ret.value += '\n';
-                    break;
-                case '\\':
-                    ret.value += '\\';
-                    break;
-                case 'f':
-                    ret.value += '\f';
-                    break;
-                case 'u':
-                    ret.value += "\\u";
-                    break;
-                default:
-                    throw ParsingError("illegal character in string", pos);
-                    break;
+    for (;;) {
+        auto start = Scan::whitespaceEnd(first, last);
+        advance(pos, first, start);
+        first = start;
+        if (first == last) {
+            return first;
+        }
+        auto end = tokenEnd(first, last, final);
+        if (!end) {
+            return first;
+        }
+        stringChecked = 0;
+        auto input = BufferInput{first, end};
+        process(scanToken(input, pos));
+        first = input.it;
+    }
+}
+
+inline const char *Json::IncrementalParser::tokenEnd(const char *first,
+                                                     const char *last,
+                                                     bool final) {
+    auto it = first + 1;
+    if (*first == '"') {
+        // Continue where the previous part ended
+        it += stringChecked;
+        for (;;) {
+            it = Scan::stringSpecial(it, last);
+            if (it == last || (*it == '\\' && it + 1 == last)) {
+                stringChecked = static_cast<size_t>(it - first - 1);
+                // Incomplete strings are reported by scanToken at the end
+                return final ? last : nullptr;
+            }
+            if (*it == '"') {
+                return it + 1;
+            }
+            it += *it == '\\' ? 2 : 1;
+        }
+    }
+    if (isNumberCharacter(*first) ||
+        std::isalpha(static_cast<unsigned char>(*first))) {
+        // Numbers and words ends where something else begins
+        while (it != last && (isNumberCharacter(*it) ||
+                              std::isalpha(static_cast<unsigned char>(*it)))) {
+            ++it;
+        }
+        return (it != last || final) ? it : nullptr;
+    }
+    return it;
+}
+
+inline void Json::IncrementalParser::process(const RawToken &token) {
+    switch (expect) {
+    case ValueOrEnd:
+        if (token.type == Token::EndBracket) {
+            close();
+            return;
+        }
+        [[fallthrough]];
+    case Value:
+        value(token);
+        return;
+    case NameOrEnd:
+        if (token.type == Token::EndBrace) {
+            close();
+            return;
+        }
+        [[fallthrough]];
+    case Name:
+        if (token.type != Token::String) {
+            JSON_THROW(ParsingError("unexpected token in object, expected name",
+                                    pos));
+        }
+        checkStrict(token);
+        builder.onKey(text(token));
+        expect = Colon;
+        return;
+    case Colon:
+        if (token.type != Token::Colon) {
+            JSON_THROW(ParsingError(
+                "unexpected token in object, expected ':' got " +
+                    std::string{token.text},
+                pos));
+        }
+        expect = Value;
+        return;
+    case ComaOrEnd: {
+        auto isObject = builder.stack.back()->type == Object;
+        if (token.type == Token::Coma) {
+            expect = isObject ? Name : Value;
+            return;
+        }
+        if (token.type != (isObject ? Token::EndBrace : Token::EndBracket)) {
+            JSON_THROW(ParsingError("unexpected character in array: " +
+                                        std::string{token.text},
+                                    pos));
+        }
+        close();
+        return;
+    }
+    case Nothing:
+        JSON_THROW(ParsingError("unexpected data after value", pos));
+    }
+}
+
+inline void Json::IncrementalParser::value(const RawToken &token) {
+    switch (token.type) {
+    case Token::String:
+        checkStrict(token);
+        builder.onString(text(token));
+        break;
+    case Token::Number: {
+        checkStrict(token);
+        auto number = NumberValue{};
+        if (!NumberValue::parse(token.text, number)) {
+            JSON_THROW(ParsingError(
+                "invalid number: " + std::string{token.text}, pos));
+        }
+        builder.onNumber(number);
+        break;
+    }
+    case Token::Null:
+        builder.onNull();
+        break;
+    case Token::BooleanTrue:
+    case Token::BooleanFalse:
+        builder.onBool(token.type == Token::BooleanTrue);
+        break;
+    case Token::BeginBrace:
+        if (builder.stack.size() >= options.maxDepth) {
+            JSON_THROW(ParsingError("maximum depth exceeded", pos));
+        }
+        builder.onBeginObject();
+        expect = NameOrEnd;
+        return;
+    case Token::BeginBracket:
+        if (builder.stack.size() >= options.maxDepth) {
+            JSON_THROW(ParsingError("maximum depth exceeded", pos));
+        }
+        builder.onBeginArray();
+        expect = ValueOrEnd;
+        return;
+    default:
+        JSON_THROW(ParsingError("unexpected token: " + std::string{token.text},
+                                pos));
+    }
+    afterValue();
+}
+
+inline void Json::IncrementalParser::close() {
+    builder.stack.pop_back();
+    afterValue();
+}
+
+inline const Json &Json::Shared::get() const {
+    if (!node) {
+        static const auto empty = Json{};
+        return empty;
+    }
+    return *node;
+}
+
+inline Json::Shared Json::Shared::at(std::string_view name) const {
+    auto &json = get();
+    auto f = json.find(name);
+    if (f == json.end()) {
+        JSON_THROW(std::out_of_range("could not find " + std::string{name} +
+                                     " in json"));
+    }
+    // Refers to the child but keeps the whole value alive
+    return std::shared_ptr<Json>{node, const_cast<Json *>(&*f)};
+}
+
+inline Json::Shared Json::Shared::at(size_t index) const {
+    auto &json = get();
+    if (index >= json.size()) {
+        JSON_THROW(std::out_of_range("index out of range in json"));
+    }
+    return std::shared_ptr<Json>{node, &json.vector()[index]};
+}
+
+inline Json &Json::Shared::edit() {
+    if (!node) {
+        node = std::make_shared<Json>();
+    }
+    else if (!unique()) {
+        node = std::make_shared<Json>(*node);
+    }
+    else {
+        // Other threads may just have released the value
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+    return *node;
+}
+
+inline Json::Path::Segment::Segment(std::string name)
+    : name(std::move(name)), hash(hashKey(this->name)) {
+    // Same as array indices in json pointers, no leading zeros or signs
+    auto &n = this->name;
+    if (n.empty() || n.size() > 18 || (n.size() > 1 && n.front() == '0')) {
+        return;
+    }
+    size_t value = 0;
+    for (auto c : n) {
+        if (c < '0' || c > '9') {
+            return;
+        }
+        value = value * 10 + static_cast<size_t>(c - '0');
+    }
+    index = value;
+}
+
+inline Json::Path::Path(std::string_view path) {
+    auto fail = [&path](const char *info) {
+        JSON_THROW(std::invalid_argument(std::string{info} + " in path " +
+                                         std::string{path}));
+    };
+
+    if (path.empty()) {
+        return;
+    }
+
+    if (path.front() == '/') {
+        auto name = std::string{};
+        for (size_t i = 1; i <= path.size(); ++i) {
+            if (i == path.size() || path[i] == '/') {
+                parts.emplace_back(std::move(name));
+                name.clear();
+            }
+            else if (path[i] == '~') {
+                auto c = i + 1 < path.size() ? path[++i] : '\0';
+                if (c != '0' && c != '1') {
+                    fail("invalid escape sequence");
                 }
+                name += c == '0' ? '~' : '/';
             }
             else {
-                ret.value += c;
+                name += path[i];
             }
-            c = getChar(stream, pos);
         }
-        return ret;
+        return;
+    }
+
+    for (size_t i = 0; i < path.size();) {
+        if (path[i] == '[') {
+            auto end = path.find(']', i);
+            if (end == std::string_view::npos) {
+                fail("missing ']'");
+            }
+            auto segment =
+                Segment{std::string{path.substr(i + 1, end - i - 1)}};
+            if (segment.index == npos) {
+                fail("invalid index");
+            }
+            parts.push_back(std::move(segment));
+            i = end + 1;
+        }
+        else {
+            auto end = path.find_first_of(".[", i);
+            end = std::min(end, path.size());
+            if (end == i) {
+                fail("empty name");
+            }
+            parts.emplace_back(std::string{path.substr(i, end - i)});
+            i = end;
+        }
+
+        if (i < path.size() && path[i] == '.') {
+            if (++i == path.size()) {
+                fail("empty name");
+            }
+        }
+        else if (i < path.size() && path[i] != '[') {
+            fail("expected '.' or '['");
+        }
+    }
+}
+
+inline std::string Json::Path::pointer() const {
+    auto ret = std::string{};
+    for (auto &segment : parts) {
+        appendPointer(ret, segment.name);
+    }
+    return ret;
+}
+
+inline const Json *Json::Path::child(const Json &json,
+                                     const Segment &segment) {
+    if (json.type == Array) {
+        return segment.index < json.size() ? &json.data()[segment.index]
+                                           : nullptr;
+    }
+    if (json.type == Object) {
+        auto f = json.find(segment.name, segment.hash);
+        return f == json.end() ? nullptr : &*f;
+    }
+    return nullptr;
+}
+
+inline const Json *Json::Path::find(const Json &json) const {
+    auto current = &json;
+    for (auto &segment : parts) {
+        current = child(*current, segment);
+        if (!current) {
+            return nullptr;
+        }
+    }
+    return current;
+}
+
+inline Json::Lazy Json::Path::find(const Lazy &lazy) const {
+    auto current = lazy;
+    auto buffer = std::string{};
+    for (auto &segment : parts) {
+        auto type = current.type();
+        if (type != Object && (type != Array || segment.index == npos)) {
+            return lazy.none();
+        }
+        auto i = current.begin();
+        auto e = current.end();
+        if (type == Object) {
+            while (i != e && !i->hasName(segment.name, buffer)) {
+                ++i;
+            }
+        }
+        else {
+            for (auto index = segment.index; i != e && index; --index) {
+                ++i;
+            }
+        }
+        if (i == e) {
+            return lazy.none();
+        }
+        current = *i;
+    }
+    return current;
+}
+
+inline const Json &Json::Path::get(const Json &json) const {
+    if (auto value = find(json)) {
+        return *value;
+    }
+    JSON_THROW(std::out_of_range("could not find " + pointer() + " in json"));
+}
+
+inline size_t Json::PathSet::add(const Path &path) {
+    size_t node = 0;
+    for (auto &segment : path.segments()) {
+        auto &children = nodes[node].children;
+        auto f = std::find_if(children.begin(), children.end(), [&](size_t i) {
+            return nodes[i].segment == segment;
+        });
+        if (f != children.end()) {
+            node = *f;
+            continue;
+        }
+        nodes[node].children.push_back(nodes.size());
+        node = nodes.size();
+        nodes.push_back(Node{segment});
+    }
+    nodes[node].paths.push_back(count);
+    return count++;
+}
+
+inline std::vector<const Json *> Json::PathSet::find(const Json &json) const {
+    auto values = std::vector<const Json *>(count, nullptr);
+    find(json, nodes.front(), values);
+    return values;
+}
+
+inline void Json::PathSet::find(const Json &json,
+                                const Node &node,
+                                std::vector<const Json *> &values) const {
+    for (auto path : node.paths) {
+        values[path] = &json;
+    }
+    for (auto i : node.children) {
+        if (auto child = Path::child(json, nodes[i].segment)) {
+            find(*child, nodes[i], values);
+        }
+    }
+}
+
+inline std::vector<Json::Lazy> Json::PathSet::find(const Lazy &lazy) const {
+    auto values = std::vector<Lazy>(count, lazy.none());
+    auto buffer = std::string{};
+    find(lazy, nodes.front(), values, buffer);
+    return values;
+}
+
+inline void Json::PathSet::find(const Lazy &lazy,
+                                const Node &node,
+                                std::vector<Lazy> &values,
+                                std::string &buffer) const {
+    for (auto path : node.paths) {
+        values[path] = lazy;
+    }
+    auto type = lazy.type();
+    if (node.children.empty() || (type != Object && type != Array)) {
+        return;
+    }
+
+    // Visit the children once and stop when all segments are matched
+    auto matched = std::vector<bool>(node.children.size(), false);
+    auto remaining = node.children.size();
+    size_t index = 0;
+    for (auto i = lazy.begin(), e = lazy.end(); i != e && remaining;
+         ++i, ++index) {
+        for (size_t c = 0; c < node.children.size(); ++c) {
+            auto &child = nodes[node.children[c]];
+            if (matched[c] || (type == Object
+                                   ? !i->hasName(child.segment.name, buffer)
+                                   : child.segment.index != index)) {
+                continue;
+            }
+            matched[c] = true;
+            --remaining;
+            find(*i, child, values, buffer);
+            break; // Segments in a node are unique
+        }
+    }
+}
+
+inline Json Json::Lazy::toJson() const {
+    auto json = Json{};
+    if (it == last) {
+        return json;
+    }
+    auto input = BufferInput{it, last};
+    auto pos = position(it);
+    auto builder = TreeBuilder{{}, json, pos};
+    auto options = ParseOptions{};
+    options.maxDepth = maxDepth - depth;
+    parseEvents(input, pos, builder, options);
+    json.name = name();
+    return json;
+}
+
+inline Json::LineReader::LineReader(std::istream &stream, Options options)
+    : stream(stream), options(options) {
+    start();
+}
+
+inline Json::LineReader::LineReader(const std::string &fname, Options options)
+    : file(std::make_unique<std::ifstream>(fname, std::ios::binary)),
+      stream(*file), options(options) {
+    start();
+}
+
+inline Json::LineReader::~LineReader() {
+    {
+        auto lock = std::lock_guard{mutex};
+        stop = true;
+    }
+    workAvailable.notify_all();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+inline Json::LineReader::iterator Json::LineReader::begin() {
+    return iterator{this};
+}
+
+inline Json::LineReader::iterator Json::LineReader::end() {
+    return iterator{nullptr};
+}
+
+inline void Json::LineReader::start() {
+#ifdef JSON_PARSE_STATS
+    options.parseOptions.stats = nullptr; // Can not be shared between threads
+#endif
+    options.threads = threadCount(options.threads);
+    if (!options.maxBlocks) {
+        options.maxBlocks = options.threads * 2;
+    }
+    options.blockSize = std::max<size_t>(options.blockSize, 1);
+    for (size_t i = 0; i < options.threads; ++i) {
+        threads.emplace_back([this] { work(); });
+    }
+}
+
+inline bool Json::LineReader::next(Json &json) {
+    for (;;) {
+        if (current && currentIndex < current->values.size()) {
+            json = std::move(current->values[currentIndex++]);
+            return true;
+        }
+        if (current && current->error) {
+            // Values before the error are returned before throwing
+            auto error = current->error;
+            current.reset();
+            std::rethrow_exception(error);
+        }
+        current.reset();
+
+        fill();
+        if (blocks.empty()) {
+            return false;
+        }
+
+        auto lock = std::unique_lock{mutex};
+        auto found = blocks.end();
+        blockDone.wait(lock, [&] {
+            if (options.ordered) {
+                found = blocks.front()->done ? blocks.begin() : blocks.end();
+            }
+            else {
+                found = std::find_if(blocks.begin(),
+                                     blocks.end(),
+                                     [](auto &block) { return block->done; });
+            }
+            return found != blocks.end();
+        });
+        current = std::move(*found);
+        blocks.erase(found);
+        currentIndex = 0;
+    }
+}
+
+inline void Json::LineReader::fill() {
+    while (blocks.size() < options.maxBlocks && stream) {
+        auto block = std::make_unique<Block>();
+        auto &text = block->text;
+        text.resize(options.blockSize);
+        stream.read(text.data(), static_cast<std::streamsize>(text.size()));
+        text.resize(static_cast<size_t>(stream.gcount()));
+        if (stream) {
+            // Complete the last line
+            auto rest = std::string{};
+            std::getline(stream, rest);
+            text += rest;
+        }
+        if (text.empty()) {
+            break;
+        }
+        if (text.back() != '\n') {
+            text += '\n'; // Removed by getline or missing at the end of input
+        }
+        block->line = line;
+        line += static_cast<size_t>(std::count(text.begin(), text.end(), '\n'));
+
+        {
+            auto lock = std::lock_guard{mutex};
+            pending.push_back(block.get());
+        }
+        blocks.push_back(std::move(block));
+        workAvailable.notify_one();
+    }
+}
+
+inline void Json::LineReader::parse(Block &block) {
+    const char *it = block.text.data();
+    const auto end = it + block.text.size();
+    auto lineNumber = block.line;
+    while (it != end) {
+        auto lineEnd = static_cast<const char *>(std::memchr(it, '\n', end - it));
+        ++lineNumber;
+        auto json = Json{};
+        auto error = json.tryParse(std::string_view(it, lineEnd - it),
+                                   options.parseOptions);
+        if (error) {
+            auto pos = error->position;
+            pos.line += static_cast<unsigned>(lineNumber - 1);
+            block.error =
+                std::make_exception_ptr(ParsingError(error->info, pos));
+            return;
+        }
+        if (json.type != None) {
+            block.values.push_back(std::move(json));
+        }
+        it = lineEnd + 1;
+    }
+}
+
+inline void Json::LineReader::work() {
+    for (;;) {
+        Block *block = nullptr;
+        {
+            auto lock = std::unique_lock{mutex};
+            workAvailable.wait(lock, [this] { return stop || !pending.empty(); });
+            if (stop) {
+                return;
+            }
+            block = pending.front();
+            pending.pop_front();
+        }
+        JSON_TRY {
+            parse(*block);
+        }
+        JSON_CATCH_ALL {
+            block->error = std::current_exception();
+        }
+        {
+            auto lock = std::lock_guard{mutex};
+            block->done = true;
+        }
+        blockDone.notify_all();
     }
+}
 
-    auto assertEq = [&pos, &stream](char c) {
-        char nc = getChar(stream, pos);
-        return (nc == c);
-    };
-
-    auto assertWord = [&assertEq](std::string_view word) {
-        for (auto c : word) {
-            if (!assertEq(c)) {
-                return false;
-            }
+inline void Json::WriteLines(std::ostream &stream,
+                             const std::vector<Json> &values,
+                             size_t threads) {
+    // Each thread writes a continuous range of values to its own buffer
+    threads = std::min(threadCount(threads), values.size());
+    auto buffers = std::vector<std::string>(threads);
+    auto write = [&](size_t index) {
+        auto first = values.size() * index / threads;
+        auto last = values.size() * (index + 1) / threads;
+        auto writer = Writer<std::string>{buffers[index], compact};
+        for (auto i = first; i < last; ++i) {
+            writer.write(values[i]);
+            buffers[index] += '\n';
         }
-        return true;
     };
 
-    if (isdigit(c) || c == '.' || c == '-') {
-        ret.value += c;
-        c = getChar(stream, pos);
+    auto workers = std::vector<std::thread>{};
+    for (size_t i = 1; i < threads; ++i) {
+        workers.emplace_back(write, i);
+    }
+    if (threads) {
+        write(0);
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    for (auto &buffer : buffers) {
+        stream.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    }
+}
 
-        while (isdigit(c) || c == '.') {
-            ret.value += c;
-            c = getChar(stream, pos);
-        }
-        stream.unget();
+template <typename Sink>
+inline void Json::BinaryWriter<Sink>::head(uint8_t major, uint64_t argument) {
+    major <<= 5;
+    if (argument < 24) {
+        append(major | static_cast<uint8_t>(argument));
+        return;
+    }
+    // Additional information 24 to 27 means that 1, 2, 4 or 8 bytes follows
+    auto info = argument <= 0xff         ? 24
+                : argument <= 0xffff     ? 25
+                : argument <= 0xffffffff ? 26
+                                         : 27;
+    auto size = 1 << (info - 24);
+    char buffer[9];
+    buffer[0] = static_cast<char>(major | info);
+    for (int i = 0; i < size; ++i) {
+        buffer[size - i] = static_cast<char>(argument >> (i * 8));
+    }
+    sink.append(buffer, static_cast<size_t>(size + 1));
+}
 
-        ret.type = Token::Number;
-        return ret;
+template <typename Sink>
+inline void Json::BinaryWriter<Sink>::write(const Json &json) {
+    switch (json.type) {
+    case None:
+        append(0xf7); // undefined
+        break;
+    case Null:
+        append(0xf6);
+        break;
+    case Boolean:
+        append(json.value == "true" ? 0xf5 : 0xf4);
+        break;
+    case String:
+        text(json.value);
+        break;
+    case Number: {
+        auto &number = json.numberValue;
+        if (number.kind == NumberValue::Unsigned) {
+            head(0, number.unsignedInteger);
+        }
+        else if (number.kind == NumberValue::Integer) {
+            if (number.integer >= 0) {
+                head(0, static_cast<uint64_t>(number.integer));
+            }
+            else {
+                head(1, static_cast<uint64_t>(-(number.integer + 1)));
+            }
+        }
+        else if (static_cast<float>(number.floating) == number.floating) {
+            // Single precision when nothing is lost
+            auto value = static_cast<float>(number.floating);
+            uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            char buffer[5] = {static_cast<char>(0xfa)};
+            for (int i = 0; i < 4; ++i) {
+                buffer[4 - i] = static_cast<char>(bits >> (i * 8));
+            }
+            sink.append(buffer, 5);
+        }
+        else {
+            uint64_t bits;
+            std::memcpy(&bits, &number.floating, sizeof(bits));
+            char buffer[9] = {static_cast<char>(0xfb)};
+            for (int i = 0; i < 8; ++i) {
+                buffer[8 - i] = static_cast<char>(bits >> (i * 8));
+            }
+            sink.append(buffer, 9);
+        }
+        break;
     }
-    else if (c == '{') {
-        return Token(Token::BeginBrace);
+    case Array:
+    case Object: {
+        auto isObject = json.type == Object;
+        head(isObject ? 5 : 4, json.size());
+        for (auto &child : json) {
+            if (isObject) {
+                text(child.name);
+            }
+            write(child);
+        }
+        break;
     }
-    else if (c == '}') {
-        return Token(Token::EndBrace);
     }
-    else if (c == '[') {
-        return Token(Token::BeginBracket);
+}
+
+template <typename Input>
+inline void Json::BinaryReader<Input>::bytes(std::string &out,
+                                             uint64_t size) {
+    if constexpr (std::is_same_v<Input, BufferInput>) {
+        if (size > remaining()) {
+            input.it = input.end;
+            fail("Unexpected end of file ");
+        }
+        out.append(input.it, static_cast<size_t>(size));
+        input.it += size;
     }
-    else if (c == ']') {
-        return Token(Token::EndBracket);
+    else {
+        // Read in parts so that a malformed size does not allocate everything
+        while (size) {
+            auto part = static_cast<size_t>(std::min<uint64_t>(size, 1 << 16));
+            auto start = out.size();
+            out.resize(start + part);
+            input.stream.read(out.data() + start,
+                              static_cast<std::streamsize>(part));
+            auto count = static_cast<size_t>(input.stream.gcount());
+            consumed += count;
+            if (count != part) {
+                fail("Unexpected end of file ");
+            }
+            size -= part;
+        }
     }
-    else if (c == ',') {
-        return Token(Token::Coma);
+}
+
+template <typename Input>
+inline uint64_t Json::BinaryReader<Input>::argument(uint8_t info) {
+    if (info < 24) {
+        return info;
     }
-    else if (c == ':') {
-        return Token(Token::Colon);
+    if (info > 27) {
+        fail("invalid additional information " + std::to_string(info));
     }
-    else if (c == 'n') {
-        if (assertWord("ull")) {
-            return Token(Token::Null);
-        }
-        else {
-            throw ParsingError(std::string{"unexpected token: "} + c, pos);
+    auto size = 1 << (info - 24);
+    uint64_t value = 0;
+    for (int i = 0; i < size; ++i) {
+        value = (value << 8) | byte();
+    }
+    return value;
+}
+
+template <typename Input>
+inline void Json::BinaryReader<Input>::text(std::string &out, uint8_t info) {
+    if (info != 31) {
+        bytes(out, argument(info));
+        return;
+    }
+    // Indefinite length, a list of definite length strings
+    while (peek() != 0xff) {
+        auto initial = byte();
+        if ((initial >> 5) != 3 || (initial & 0x1f) == 31) {
+            fail("invalid chunk in text string");
         }
+        bytes(out, argument(initial & 0x1f));
     }
-    else if (c == 't') {
-        if (assertWord("rue")) {
-            ret.type = Token::BooleanTrue;
-            return ret;
+    byte();
+}
+
+template <typename Input>
+inline void Json::BinaryReader<Input>::read(Json &json, size_t depth) {
+    auto initial = byte();
+    // Tags are ignored, skipped in a loop so that many tags do not recurse
+    while ((initial >> 5) == 6) {
+        argument(static_cast<uint8_t>(initial & 0x1f));
+        initial = byte();
+    }
+    auto major = initial >> 5;
+    auto info = static_cast<uint8_t>(initial & 0x1f);
+
+    switch (major) {
+    case 0:
+        json.type = Number;
+        json.numberValue = NumberValue{argument(info)};
+        break;
+    case 1: {
+        auto value = argument(info);
+        json.type = Number;
+        if (value > static_cast<uint64_t>(INT64_MAX)) {
+            json.numberValue = NumberValue{-1. - static_cast<double>(value)};
         }
         else {
-            throw ParsingError(std::string{"unexpected token: "} + c, pos);
+            json.numberValue = NumberValue{-1 - static_cast<int64_t>(value)};
         }
+        break;
     }
-    else if (c == 'f') {
-        if (assertWord("alse")) {
-            ret.type = Token::BooleanFalse;
-            return ret;
+    case 3:
+        json.type = String;
+        text(json.value, info);
+        break;
+    case 4:
+    case 5:
+        container(json, major == 5, info == 31 ? npos : argument(info), depth);
+        break;
+    case 7:
+        simple(json, info);
+        break;
+    default:
+        fail("byte strings are not supported");
+    }
+}
+
+template <typename Input>
+inline void Json::BinaryReader<Input>::container(Json &json,
+                                                 bool isObject,
+                                                 uint64_t size,
+                                                 size_t depth) {
+    if (depth >= options.maxDepth) {
+        fail("maximum depth exceeded");
+    }
+    json.type = isObject ? Object : Array;
+    if (size != npos) {
+        json.reserve(
+            static_cast<size_t>(std::min<uint64_t>(size, remaining())));
+    }
+    for (uint64_t i = 0; i < size; ++i) {
+        if (size == npos && peek() == 0xff) {
+            byte();
+            break;
         }
-        else {
-            throw ParsingError(std::string{"unexpected token: "} + c, pos);
+        auto &child = json.emplace_back();
+        if (isObject) {
+            auto initial = byte();
+            if ((initial >> 5) != 3) {
+                fail("expected text string as name");
+            }
+            text(child.name, initial & 0x1f);
         }
+        read(child, depth + 1);
     }
-    else if (c == -1) {
-        // End of file probably because the file was empty
-        return Token(Token::None);
+}
+
+template <typename Input>
+inline void Json::BinaryReader<Input>::simple(Json &json, uint8_t info) {
+    switch (info) {
+    case 20:
+    case 21:
+        json.type = Boolean;
+        json.value = info == 21 ? "true" : "false";
+        return;
+    case 22:
+        json.type = Null;
+        return;
+    case 23:
+        return; // undefined
+    case 25: {
+        // Half precision
+        auto bits = static_cast<unsigned>(argument(info));
+        auto exponent = static_cast<int>((bits >> 10) & 0x1f);
+        auto mantissa = static_cast<double>(bits & 0x3ff);
+        auto value =
+            exponent == 0    ? std::ldexp(mantissa, -24)
+            : exponent == 31 ? (mantissa == 0 ? HUGE_VAL : std::nan(""))
+                             : std::ldexp(mantissa + 1024, exponent - 25);
+        json.type = Number;
+        json.numberValue = NumberValue{(bits & 0x8000) ? -value : value};
+        return;
     }
-    else {
-        throw ParsingError{std::string{"unexpected character: "} + c, pos};
+    case 26: {
+        auto bits = static_cast<uint32_t>(argument(info));
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        json.type = Number;
+        json.numberValue = NumberValue{value};
+        return;
+    }
+    case 27: {
+        auto bits = argument(info);
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        json.type = Number;
+        json.numberValue = NumberValue{value};
+        return;
+    }
+    default:
+        fail("unsupported simple value " + std::to_string(info));
     }
-    return Token(Token::None);
 }
 
-inline void Json::parse(std::istream &ss,
-                        Json::Position &pos,
-                        Json::Token rest) {
-    Token token = rest;
+inline std::string Json::binary() const {
+    auto out = std::string{};
+    BinaryWriter<std::string>{out}.write(*this);
+    return out;
+}
 
-    if (pos == Position{1, 1}) {
-        removeBom(ss);
+inline void Json::writeBinary(std::ostream &stream) const {
+    auto sink = StreamSink{stream};
+    BinaryWriter<StreamSink>{sink}.write(*this);
+}
+
+inline void Json::saveBinary(std::string fname) const {
+    auto file = std::ofstream{fname, std::ios::binary};
+    writeBinary(file);
+}
+
+inline Json Json::ParseBinary(std::string_view data, ParseOptions options) {
+    auto json = Json{};
+    if (data.empty()) {
+        return json;
     }
-    if (rest.type == rest.None) {
-        token = getNextToken(ss, pos);
-        value = "";
-        this->pos = pos;
+    auto input = BufferInput{data.data(), data.data() + data.size()};
+    BinaryReader<BufferInput>{input, options}.read(json);
+    return json;
+}
+
+inline Json Json::ParseBinary(std::istream &stream, ParseOptions options) {
+    auto json = Json{};
+    if (stream.peek() == std::char_traits<char>::eof()) {
+        return json;
+    }
+    auto input = StreamInput{stream};
+    BinaryReader<StreamInput>{input, options}.read(json);
+    return json;
+}
+
+inline Json Json::LoadBinary(std::string fname, ParseOptions options) {
+    return ParseBinary(FileMapping{fname}.view(), options);
+}
+
+inline Json Json::LoadFile(std::string fname, ParseOptions options) {
+    return Json::Parse(FileMapping{fname}.view(), options);
+}
+
+inline Json &Json::loadFile(std::string fname, ParseOptions options) {
+    return parse(FileMapping{fname}.view(), options);
+}
+
+#ifdef JSON_MMAP
+
+inline Json::FileMapping::FileMapping(const std::string &fname) {
+    auto fd = ::open(fname.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
     }
-    if (token.type == token.String) {
-        type = String;
-        value = token.value;
-        this->pos = pos;
+    struct stat info = {};
+    if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+        auto size = static_cast<size_t>(info.st_size);
+        auto address = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address != MAP_FAILED) {
+            data = static_cast<const char *>(address);
+            this->size = size;
+        }
     }
-    else if (token.type == token.Number) {
-        type = Number;
-        value = token.value;
-        this->pos = pos;
+    ::close(fd);
+    if (!data) {
+        // For example pipes and special files that can not be mapped
+        content = readFile(fname);
+        data = content.data();
+        size = content.size();
     }
-    else if (token.type == token.BeginBrace) {
-        type = Object;
+}
 
-        auto token = getNextToken(ss, pos);
+inline Json::FileMapping::~FileMapping() {
+    if (data && data != content.data()) {
+        ::munmap(const_cast<char *>(data), size);
+    }
+}
 
-        if (token.type == token.EndBrace) {
-            return; // Empty array
-        }
+#else
 
-        bool running = true;
-        while (running) {
-            Json json;
-            json.name = token.value;
+inline Json::FileMapping::FileMapping(const std::string &fname)
+    : content(readFile(fname)) {
+    data = content.data();
+    size = content.size();
+}
 
-            token = getNextToken(ss, pos);
+inline Json::FileMapping::~FileMapping() = default;
 
-            if (token.type != Token::Colon) {
-                throw ParsingError(
-                    "unexpexted token in object, expected ':' got " +
-                        token.value,
-                    pos);
-            }
+#endif
 
-            token = getNextToken(ss, pos);
+inline void Json::planChunks(std::vector<Chunk> &chunks,
+                             int indent,
+                             int level,
+                             const StringifyOptions &options) const {
+    // The writers refer to the last chunk and are created when needed since
+    // adding chunks moves the strings
+    auto writer = [&](int level) {
+        return Writer<std::string>{chunks.back().text, indent, level};
+    };
 
-            json.parse(ss, pos, token);
-            if (json.type == None) {
-                throw ParsingError("error in array", pos);
-            }
+    if ((type != Object && type != Array) || empty()) {
+        writer(level).write(*this);
+        return;
+    }
 
-            push_back(json);
+    auto isObject = type == Object;
+    chunks.back().text += isObject ? '{' : '[';
+    if (size() >= options.threshold) {
+        // Several chunks per thread evens out differences in size
+        auto chunkSize = std::max<size_t>(
+            size() / (threadCount(options.threads) * 8), 1);
+        for (size_t i = 0; i < size(); i += chunkSize) {
+            auto &chunk = chunks.back();
+            chunk.parent = this;
+            chunk.first = i;
+            chunk.last = std::min(i + chunkSize, size());
+            chunk.level = level + 1;
+            chunks.emplace_back();
+        }
+    }
+    else {
+        for (size_t i = 0; i < size(); ++i) {
+            auto &child = data()[i];
+            writer(level + 1).beginChild(i == 0, isObject, child.name);
+            child.planChunks(chunks, indent, level + 1, options);
+        }
+    }
+    writer(level).newline();
+    chunks.back().text += isObject ? '}' : ']';
+}
 
-            token = getNextToken(ss, pos);
+inline std::vector<Json::Chunk> Json::writeChunks(
+    int indent, const StringifyOptions &options) const {
+    auto chunks = std::vector<Chunk>(1);
+    planChunks(chunks, indent, 0, options);
+    if (chunks.size() == 1) {
+        return chunks; // Nothing was large enough to split
+    }
 
-            if (token.type == token.EndBrace) {
-                return; // End of array
-            }
-            if (token.type == token.Coma) {
-                token = getNextToken(ss, pos);
-            }
-            else {
-                throw ParsingError(
-                    "unexpected character in array: " + token.value, pos);
+    // Each thread takes the next chunk that is not taken, so threads that
+    // get small chunks continue with more work
+    auto next = std::atomic<size_t>{0};
+    auto work = [&] {
+        for (auto i = next++; i < chunks.size(); i = next++) {
+            auto &chunk = chunks[i];
+            if (chunk.parent) {
+                Writer<std::string>{chunk.children, indent, chunk.level}
+                    .writeChildren(*chunk.parent, chunk.first, chunk.last);
             }
         }
+    };
+
+    auto threads = std::min(threadCount(options.threads), chunks.size());
+    auto workers = std::vector<std::thread>{};
+    for (size_t i = 1; i < threads; ++i) {
+        workers.emplace_back(work);
     }
-    else if (token.type == token.Null) {
-        type = Null;
+    work();
+    for (auto &worker : workers) {
+        worker.join();
     }
-    else if (token.type == token.BooleanTrue) {
-        type = Boolean;
-        value = "true";
+    return chunks;
+}
+
+inline std::string Json::stringify(int indent,
+                                   const StringifyOptions &options) const {
+    auto chunks = writeChunks(indent, options);
+    auto size = size_t{0};
+    for (auto &chunk : chunks) {
+        size += chunk.text.size() + chunk.children.size();
     }
-    else if (token.type == token.BooleanFalse) {
-        type = Boolean;
-        value = "false";
+    auto out = std::string{};
+    out.reserve(size);
+    for (auto &chunk : chunks) {
+        out += chunk.text;
+        out += chunk.children;
     }
-    else if (token.type == token.BeginBracket) {
-        type = Array;
+    return out;
+}
 
-        auto token = getNextToken(ss, pos);
+inline void Json::saveFile(std::string fname,
+                           int indent,
+                           const StringifyOptions &options) const {
+    auto file = std::ofstream{fname, std::ios::binary};
+    for (auto &chunk : writeChunks(indent, options)) {
+        file.write(chunk.text.data(),
+                   static_cast<std::streamsize>(chunk.text.size()));
+        file.write(chunk.children.data(),
+                   static_cast<std::streamsize>(chunk.children.size()));
+    }
+}
 
-        if (token.type == token.EndBracket) {
-            return; // Empty array
+inline void Json::appendPointer(std::string &pointer, std::string_view name) {
+    pointer += '/';
+    for (auto c : name) {
+        if (c == '~') {
+            pointer += "~0";
+        }
+        else if (c == '/') {
+            pointer += "~1";
         }
+        else {
+            pointer += c;
+        }
+    }
+}
 
-        bool running = true;
-        while (running) {
-            Json json;
+inline std::pair<Json::NumberValue::Kind, uint64_t> Json::canonical(
+    const NumberValue &number) {
+    if (number.kind == NumberValue::Integer) {
+        return {number.kind, static_cast<uint64_t>(number.integer)};
+    }
+    if (number.kind == NumberValue::Unsigned) {
+        return {number.kind, number.unsignedInteger};
+    }
+    auto value = number.floating;
+    if (std::trunc(value) == value) {
+        if (value >= -9223372036854775808.0 && value < 9223372036854775808.0) {
+            auto integer = static_cast<int64_t>(value);
+            return {NumberValue::Integer, static_cast<uint64_t>(integer)};
+        }
+        if (value >= 0 && value < 18446744073709551616.0) {
+            return {NumberValue::Unsigned, static_cast<uint64_t>(value)};
+        }
+    }
+    auto bits = uint64_t{};
+    std::memcpy(&bits, &value, sizeof(bits));
+    return {NumberValue::Floating, bits};
+}
 
-            json.parse(ss, pos, token);
-            if (json.type == None) {
-                throw ParsingError{"error in array", pos};
+inline bool Json::operator==(const Json &other) const {
+    if (type != other.type || size() != other.size()) {
+        return false;
+    }
+    switch (type) {
+    case Number:
+        return canonical(numberValue) == canonical(other.numberValue);
+    case String:
+    case Boolean:
+        return value == other.value;
+    case Array:
+        return std::equal(begin(), end(), other.begin());
+    case Object:
+        for (size_t i = 0; i < size(); ++i) {
+            auto &child = data()[i];
+            // Members are usually in the same order
+            if (child.name == other.data()[i].name) {
+                if (child != other.data()[i]) {
+                    return false;
+                }
+                continue;
             }
+            auto f = other.find(child.name);
+            if (f == other.end() || child != *f) {
+                return false;
+            }
+        }
+        return true;
+    default:
+        return true;
+    }
+}
 
-            push_back(json);
+inline uint64_t Json::hashTree(const Json &json, std::vector<TreeHash> *nodes) {
+    // Finalizer from splitmix64
+    auto mix = [](uint64_t hash) {
+        hash ^= hash >> 30;
+        hash *= 0xbf58476d1ce4e5b9ull;
+        hash ^= hash >> 27;
+        hash *= 0x94d049bb133111ebull;
+        return hash ^ (hash >> 31);
+    };
 
-            token = getNextToken(ss, pos);
+    auto index = size_t{0};
+    if (nodes) {
+        index = nodes->size();
+        nodes->emplace_back();
+    }
 
-            if (token.type == token.EndBracket) {
-                return; // End of array
-            }
-            if (token.type == token.Coma) {
-                token = getNextToken(ss, pos);
-            }
-            else {
-                throw ParsingError{
-                    "unexpected character in array: " + token.value, pos};
-            }
+    auto hash = mix(json.type);
+    switch (json.type) {
+    case Number: {
+        auto [kind, bits] = canonical(json.numberValue);
+        hash = mix(hash ^ kind ^ mix(bits));
+        break;
+    }
+    case String:
+    case Boolean: {
+        // Eight bytes at a time since values can be long
+        auto text = std::string_view{json.value};
+        auto it = text.data();
+        auto end = it + text.size();
+        for (; end - it >= 8; it += 8) {
+            auto word = uint64_t{};
+            std::memcpy(&word, it, 8);
+            hash = (hash ^ word) * 0x9e3779b97f4a7c15ull;
         }
+        hash = mix(hash ^ hashKey({it, static_cast<size_t>(end - it)}) ^
+                   text.size());
+        break;
+    }
+    case Array:
+        for (auto &child : json) {
+            hash = mix(hash + hashTree(child, nodes));
+        }
+        break;
+    case Object: {
+        // The sum does not depend on the order of the members
+        auto sum = uint64_t{0};
+        for (auto &child : json) {
+            sum += mix(hashKey(child.name) ^ hashTree(child, nodes));
+        }
+        hash = mix(hash ^ sum);
+        break;
+    }
+    default:
+        break;
     }
-}
 
-inline Json &Json::parse(std::istream &ss) {
-    Position pos;
-    parse(ss, pos);
-    return *this;
+    if (nodes) {
+        (*nodes)[index] = {hash, nodes->size() - index};
+    }
+    return hash;
 }
 
-inline void Json::escapeString(std::ostream &stream, std::string str) {
-    stream << '"';
-    for (auto c : str) {
-        switch (c) {
-        case '\n':
-            stream << "\\n";
-            break;
-        case '\r':
-            stream << "\\r";
-            break;
-        case '\t':
-            stream << "\\t";
-            break;
-        case '\f':
-            stream << "\\f";
-            break;
-        case '\b':
-            stream << "\\b";
-            break;
-        case '"':
-            stream << "\\\"";
-            break;
-        case '\\':
-            stream << "\\\\";
-            break;
-        default:
-            stream << c;
+//! Creates the patch for Json::Diff
+//! The hash of every value in both trees is calculated once, and values are
+//! found in the hash vectors by their depth first index
+class Json::Differ {
+public:
+    Differ(const Json &from, const Json &to) {
+        hashTree(from, &fromHashes);
+        hashTree(to, &toHashes);
+    }
+
+    void diff(const Json &from,
+              size_t fromIndex,
+              const Json &to,
+              size_t toIndex);
+
+    Json patch = Json{Array};
+
+private:
+    bool equal(const Json &from,
+               size_t fromIndex,
+               const Json &to,
+               size_t toIndex) const {
+        auto &fromHash = fromHashes[fromIndex];
+        auto &toHash = toHashes[toIndex];
+        return fromHash.hash == toHash.hash && fromHash.size == toHash.size &&
+               from.type == to.type && from.size() == to.size();
+    }
+
+    //! Index of each child in the hash vector
+    static std::vector<size_t> children(const std::vector<TreeHash> &hashes,
+                                        size_t index,
+                                        size_t count) {
+        auto indices = std::vector<size_t>(count);
+        ++index;
+        for (auto &child : indices) {
+            child = index;
+            index += hashes[index].size;
+        }
+        return indices;
+    }
+
+    void add(const char *op, const Json *value) {
+        auto &operation = patch.emplace_back(Object);
+        operation["op"].string(op);
+        operation["path"].string(path);
+        if (value) {
+            operation.push_back(*value);
+            operation.back().name = "value";
         }
     }
-    stream << '"';
+
+    void diffObjects(const Json &from,
+                     size_t fromIndex,
+                     const Json &to,
+                     size_t toIndex);
+
+    void diffArrays(const Json &from,
+                    size_t fromIndex,
+                    const Json &to,
+                    size_t toIndex);
+
+    std::vector<TreeHash> fromHashes;
+    std::vector<TreeHash> toHashes;
+    std::string path; // JSON pointer to the current value
+};
+
+inline void Json::Differ::diff(const Json &from,
+                               size_t fromIndex,
+                               const Json &to,
+                               size_t toIndex) {
+    if (equal(from, fromIndex, to, toIndex)) {
+        return;
+    }
+    if (from.type == to.type && from.type == Object) {
+        diffObjects(from, fromIndex, to, toIndex);
+    }
+    else if (from.type == to.type && from.type == Array) {
+        diffArrays(from, fromIndex, to, toIndex);
+    }
+    else {
+        add("replace", &to);
+    }
 }
 
-inline void Json::stringify(std::ostream &stream,
-                            int indent,
-                            int startIndent) const {
-    if (type == Number) {
-        stream << value;
+inline void Json::Differ::diffObjects(const Json &from,
+                                      size_t fromIndex,
+                                      const Json &to,
+                                      size_t toIndex) {
+    auto toChildren = children(toHashes, toIndex, to.size());
+    auto length = path.size();
+    auto childIndex = fromIndex + 1;
+    for (auto &child : from) {
+        appendPointer(path, child.name);
+        auto f = to.find(child.name);
+        if (f == to.end()) {
+            add("remove", nullptr);
+        }
+        else {
+            diff(child, childIndex, *f, toChildren[f - to.begin()]);
+        }
+        path.resize(length);
+        childIndex += fromHashes[childIndex].size;
     }
-    else if (type == String) {
-        escapeString(stream, value);
+    for (auto &child : to) {
+        if (from.find(child.name) == from.end()) {
+            appendPointer(path, child.name);
+            add("add", &child);
+            path.resize(length);
+        }
     }
-    else if (type == Null) {
-        stream << "null";
+}
+
+inline void Json::Differ::diffArrays(const Json &from,
+                                     size_t fromIndex,
+                                     const Json &to,
+                                     size_t toIndex) {
+    auto fromChildren = children(fromHashes, fromIndex, from.size());
+    auto toChildren = children(toHashes, toIndex, to.size());
+    auto same = [&](size_t i, size_t j) {
+        return equal(
+            from.data()[i], fromChildren[i], to.data()[j], toChildren[j]);
+    };
+
+    // Skip the unchanged beginning and end
+    auto shortest = std::min(from.size(), to.size());
+    auto first = size_t{0};
+    while (first < shortest && same(first, first)) {
+        ++first;
     }
-    else if (type == Boolean) {
-        stream << value;
+    auto last = size_t{0};
+    while (last < shortest - first &&
+           same(from.size() - 1 - last, to.size() - 1 - last)) {
+        ++last;
     }
-    else if (type == Object) {
-        if (empty()) {
-            stream << "{}";
-            return;
+
+    // Align the rest by finding where elements are moved to by their hash
+    auto fromEnd = from.size() - last;
+    auto toEnd = to.size() - last;
+    auto positions = [](const std::vector<TreeHash> &hashes,
+                        const std::vector<size_t> &indices,
+                        size_t begin,
+                        size_t end) {
+        auto ret = std::unordered_map<uint64_t, std::vector<size_t>>{};
+        for (auto i = begin; i < end; ++i) {
+            ret[hashes[indices[i]].hash].push_back(i);
         }
-        stream << "{\n";
-        bool first = true;
-        for (auto &it : *this) {
-            if (first) {
-                first = false;
+        return ret;
+    };
+    auto fromPositions = positions(fromHashes, fromChildren, first, fromEnd);
+    auto toPositions = positions(toHashes, toChildren, first, toEnd);
+
+    // Distance to the next equal element after position, 0 if not found
+    auto distance = [](const std::unordered_map<uint64_t, std::vector<size_t>>
+                           &table,
+                       uint64_t hash,
+                       size_t position,
+                       auto equal) -> size_t {
+        auto found = table.find(hash);
+        if (found == table.end()) {
+            return 0;
+        }
+        auto &list = found->second;
+        for (auto it = std::upper_bound(list.begin(), list.end(), position);
+             it != list.end();
+             ++it) {
+            if (equal(*it)) {
+                return *it - position;
             }
-            else {
-                stream << ",\n";
+        }
+        return 0;
+    };
+
+    // Elements before j in to are done and from[i] is now at index j
+    auto length = path.size();
+    auto at = [&](size_t index) {
+        path.resize(length);
+        appendPointer(path, std::to_string(index));
+    };
+    auto i = first;
+    auto j = first;
+    while (i < fromEnd && j < toEnd) {
+        if (same(i, j)) {
+            ++i;
+            ++j;
+            continue;
+        }
+        auto inserted = distance(
+            toPositions, fromHashes[fromChildren[i]].hash, j, [&](size_t k) {
+                return k < toEnd && same(i, k);
+            });
+        auto removed = distance(
+            fromPositions, toHashes[toChildren[j]].hash, i, [&](size_t k) {
+                return k < fromEnd && same(k, j);
+            });
+        if (inserted && (!removed || inserted <= removed)) {
+            for (auto end = j + inserted; j < end; ++j) {
+                at(j);
+                add("add", to.data() + j);
+            }
+        }
+        else if (removed) {
+            at(j);
+            for (auto end = i + removed; i < end; ++i) {
+                add("remove", nullptr);
             }
-            this->indent(stream, (startIndent + 1) * indent);
-            escapeString(stream, it.name);
-            stream << ": ";
-            it.stringify(stream, indent, startIndent + 1);
         }
-        stream << "\n";
-        this->indent(stream, startIndent * indent);
-        stream << "}";
+        else {
+            at(j);
+            diff(from.data()[i], fromChildren[i], to.data()[j], toChildren[j]);
+            ++i;
+            ++j;
+        }
     }
-    else if (type == Array) {
-        if (empty()) {
-            stream << "[]";
-            return;
+    for (; j < toEnd; ++j) {
+        at(j);
+        add("add", to.data() + j);
+    }
+    if (i < fromEnd) {
+        // Each removal moves the following elements back
+        at(j);
+        for (; i < fromEnd; ++i) {
+            add("remove", nullptr);
         }
-        stream << "[\n";
+    }
+    path.resize(length);
+}
 
-        auto it = begin();
+inline Json Json::Diff(const Json &from, const Json &to) {
+    auto differ = Differ{from, to};
+    differ.diff(from, 0, to, 0);
+    return std::move(differ.patch);
+}
 
-        this->indent(stream, (startIndent + 1) * indent);
-        it->stringify(stream, indent, startIndent + 1);
-        for (it = it + 1; it != end(); ++it) {
-            stream << ",\n";
-            this->indent(stream, (startIndent + 1) * indent);
-            it->stringify(stream, indent, startIndent + 1);
-        }
-        stream << "\n";
-        this->indent(stream, startIndent * indent);
-        stream << "]";
+namespace std {
+
+//! For using Json in std::unordered_set and as key in std::unordered_map
+template <>
+struct hash<Json> {
+    size_t operator()(const Json &json) const {
+        return static_cast<size_t>(json.hash());
     }
-}
+};
+
+} // namespace std
@@ -7,9 +7,33 @@
 
 #include "mls-unit-test/unittest.h"
 #include "json/json.h"
+#include <functional>
+#include <unordered_set>
 
 using namespace std::literals;
 
+namespace testtypes {
+
+struct Point {
+    double x = 0;
+    double y = 0;
+};
+
+JSON_FIELDS(Point, x, y)
+
+struct Shape {
+    std::string name;
+    Point position;
+    std::vector<std::string> tags;
+    std::vector<Point> path;
+    bool visible = false;
+    std::optional<int> weight;
+};
+
+JSON_FIELDS(Shape, name, position, tags, path, visible, weight)
+
+} // namespace testtypes
+
 TEST_SUIT_BEGIN(Jsontest)
 
 TEST_CASE("simple parsing test") {
@@ -133,4 +157,1337 @@ TEST_CASE("booleans") {
     ASSERT_EQ(y.value, "false");
 }
 
+TEST_CASE("buffer and stream parsing give the same result") {
+    auto testJson = R"_(
+{
+   "x": "hel\"lo",
+   "numbers": [1, 2.5, -3],
+   "nested": {"a": null, "b": true}
+}
+    )_"s;
+
+    auto fromBuffer = Json::Parse(testJson);
+    auto ss = std::istringstream{testJson};
+    auto fromStream = Json::Parse(ss);
+
+    ASSERT_EQ(fromBuffer.stringify(), fromStream.stringify());
+    ASSERT_EQ(fromBuffer["x"].string(), "hel\"lo");
+    ASSERT_EQ(fromBuffer["nested"]["b"].line(),
+              fromStream["nested"]["b"].line());
+    ASSERT_EQ(fromBuffer["nested"]["b"].col(), fromStream["nested"]["b"].col());
+    ASSERT_EQ(fromBuffer["numbers"].col(), fromStream["numbers"].col());
+}
+
+TEST_CASE("buffer parsing errors") {
+    bool thrown = false;
+    try {
+        Json::Parse("{\"x\": \"unterminated");
+    }
+    catch (Json::ParsingError &e) {
+        thrown = true;
+        ASSERT_EQ(e.position.line, 1);
+    }
+    ASSERT(thrown, "expected parsing error");
+}
+
+TEST_CASE("load file") {
+    auto json = Json::Parse("{\"a\": [1, 2, 3]}");
+    json.saveFile("json_test_load_file.json");
+
+    auto loaded = Json::LoadFile("json_test_load_file.json");
+    ASSERT_EQ(loaded.stringify(), json.stringify());
+
+    std::remove("json_test_load_file.json");
+
+    auto missing = Json::LoadFile("json_test_does_not_exist.json");
+    ASSERT_EQ(missing.type, Json::None);
+}
+
+TEST_CASE("map file") {
+    auto json = Json::Parse(R"({"plain": "a long string without escapes",
+                                 "escaped": "line\nbreak",
+                                 "list": ["one", "two", 3]})");
+    json.saveFile("json_test_map_file.json");
+
+    auto copy = Json::Document{};
+    {
+        auto mapped = Json::Document::MapFile("json_test_map_file.json");
+        auto loaded = Json::Document::LoadFile("json_test_map_file.json");
+        ASSERT_EQ(mapped.stringify(), json.stringify());
+        ASSERT_EQ(loaded.stringify(), json.stringify());
+        ASSERT_EQ(mapped["escaped"].string(), "line\nbreak");
+        ASSERT_LT(mapped.memoryUsage(), loaded.memoryUsage());
+        copy = mapped;
+    }
+    // The copy keeps the file mapped
+    ASSERT_EQ(copy["plain"].string(), "a long string without escapes");
+    ASSERT_EQ(copy["list"][1].string(), "two");
+
+    auto file = Json::FileMapping{"json_test_map_file.json"};
+    ASSERT_EQ(Json::ParseLazy(file.view())["list"][2].asInt64(), 3);
+
+    std::remove("json_test_map_file.json");
+
+    auto missing = Json::Document::MapFile("json_test_does_not_exist.json");
+    ASSERT_EQ(missing.type(), Json::None);
+}
+
+TEST_CASE("interned names") {
+    auto text = std::string{"["};
+    for (int i = 0; i < 200; ++i) {
+        text += (i ? "," : "") + std::string{R"({"timestamp": )"} +
+                std::to_string(i) +
+                R"(, "user_id": "u", "escaped\tname": true, "k)" +
+                std::to_string(i % 100) + R"(": null})";
+    }
+    text += "]";
+
+    auto options = Json::ParseOptions{};
+    options.internNames = true;
+    auto interned = Json::Document::Parse(text, options);
+    auto plain = Json::Document::Parse(text);
+
+    ASSERT_EQ(interned.stringify(), plain.stringify());
+    ASSERT_LT(interned.memoryUsage(), plain.memoryUsage());
+
+    auto record = interned[150];
+    ASSERT_EQ(record["timestamp"].asInt64(), 150);
+    ASSERT_EQ(record["escaped\tname"].boolean(), true);
+    ASSERT_EQ(record["k50"].type(), Json::Null);
+    ASSERT_EQ((*record.find("user_id")).name(), "user_id");
+    ASSERT(record.find("k51") == record.end(), "name from other record");
+    ASSERT(record.find("missing") == record.end(), "name that is not used");
+
+    // Names that refers to a mapped file
+    Json::Parse(text).saveFile("json_test_interned.json");
+    auto mapped = Json::Document::MapFile("json_test_interned.json", options);
+    ASSERT_EQ(mapped.stringify(), plain.stringify());
+    ASSERT_EQ(mapped[199]["k99"].type(), Json::Null);
+    std::remove("json_test_interned.json");
+}
+
+TEST_CASE("escape and parse long strings") {
+    // Put special characters at every offset to cover all vector lengths
+    for (size_t offset = 0; offset < 70; ++offset) {
+        for (char special : {'"', '\\', '\n', '\t', '\x01'}) {
+            auto str = std::string(offset, 'a') + special + std::string(40, 'b');
+            auto json = Json{str};
+            auto text = json.stringify();
+            auto padded = "[" + std::string(offset, ' ') + text +
+                          std::string(offset, '\n') + "]";
+
+            auto parsed = Json::Parse(padded);
+            ASSERT_EQ(parsed.size(), 1);
+            ASSERT_EQ(parsed.front().string(), str);
+            ASSERT_EQ(parsed.stringify(0), "[\n" + text + "\n]");
+        }
+    }
+}
+
+TEST_CASE("native numbers") {
+    auto json = Json::Parse(
+        "[10, -3, 10.5, 1e3, 2.5E-2, 18446744073709551615, 0.1, 1e400]");
+
+    ASSERT_EQ(json[0].asInt64(), 10);
+    ASSERT_EQ(json[0].numberValue.kind, Json::NumberValue::Integer);
+    ASSERT_EQ(json[1].asInt64(), -3);
+    ASSERT_EQ(json[2].asDouble(), 10.5);
+    ASSERT_EQ(json[2].numberValue.kind, Json::NumberValue::Floating);
+    ASSERT_EQ(json[3].asDouble(), 1000.);
+    ASSERT_EQ(json[4].asDouble(), 0.025);
+    ASSERT_EQ(json[5].asUInt64(), 18446744073709551615ull);
+    ASSERT_EQ(json[5].numberValue.kind, Json::NumberValue::Unsigned);
+    ASSERT_EQ(json[6].asDouble(), 0.1);
+    ASSERT_EQ(json[0].value, "");
+
+    ASSERT_EQ(Json{10.5}.stringify(), "10.5");
+    ASSERT_EQ(Json{0.1}.stringify(), "0.1");
+    ASSERT_EQ(Json{-7}.stringify(), "-7");
+    ASSERT_EQ(json[5].stringify(), "18446744073709551615");
+    ASSERT_EQ(json[7].stringify(), "null");
+
+    // Values out of range are clamped instead of wrapped
+    auto large = Json::Parse("[1e300, -1e300, -1, 1e10, -2.7, 2.7, 1e999]");
+    ASSERT_EQ(large[0].asInt64(), INT64_MAX);
+    ASSERT_EQ(large[1].asInt64(), INT64_MIN);
+    ASSERT_EQ(large[2].asUInt64(), 0u);
+    ASSERT_EQ(large[1].asUInt64(), 0u);
+    ASSERT_EQ(large[0].asUInt64(), UINT64_MAX);
+    ASSERT_EQ(large[3].numberValue.as<int>(), std::numeric_limits<int>::max());
+    ASSERT_EQ(large[4].asInt64(), -2);
+    ASSERT_EQ(large[5].numberValue.as<unsigned>(), 2u);
+    ASSERT_EQ(json[5].asInt64(), INT64_MAX);
+    ASSERT_EQ(json[5].numberValue.as<uint32_t>(), UINT32_MAX);
+    ASSERT_EQ(Json{-5}.numberValue.as<uint8_t>(), 0u);
+    ASSERT_EQ(Json{std::nan("")}.asInt64(), 0);
+
+    // exact() only converts values that fit
+    ASSERT(large[3].numberValue.exact<int64_t>() == 10000000000, "fits");
+    ASSERT(!large[3].numberValue.exact<int>(), "too large");
+    ASSERT(!large[2].numberValue.exact<uint64_t>(), "negative");
+    ASSERT(!large[5].numberValue.exact<int>(), "not integral");
+    ASSERT(!large[6].numberValue.exact<int64_t>(), "infinite");
+    ASSERT(large[5].numberValue.exact<double>() == 2.7, "floating");
+    ASSERT(json[5].numberValue.exact<uint64_t>() == UINT64_MAX, "unsigned");
+    ASSERT(!json[5].numberValue.exact<int64_t>(), "unsigned too large");
+
+    // Shortest round trip
+    auto value = 1. / 3.;
+    ASSERT_EQ(Json::Parse(Json{value}.stringify()).asDouble(), value);
+
+    bool thrown = false;
+    try {
+        Json::Parse("[1.2.3]");
+    }
+    catch (Json::ParsingError &) {
+        thrown = true;
+    }
+    ASSERT(thrown, "expected invalid number to throw");
+
+    thrown = false;
+    try {
+        Json{"text"}.asDouble();
+    }
+    catch (std::runtime_error &) {
+        thrown = true;
+    }
+    ASSERT(thrown, "expected type error");
+}
+
+TEST_CASE("lookup in large objects") {
+    auto json = Json{};
+    for (int i = 0; i < 1000; ++i) {
+        json["key" + std::to_string(i)].number(i);
+    }
+    ASSERT_EQ(json.size(), 1000);
+    ASSERT_EQ(json["key500"].asInt64(), 500);
+    ASSERT(json.find(std::string_view{"missing"}) == json.end(), "");
+
+    json.remove("key500");
+    ASSERT_EQ(json.size(), 999);
+    ASSERT(json.find("key500") == json.end(), "removed");
+    ASSERT_EQ(json["key501"].asInt64(), 501);
+
+    // Children added directly to the vector are found too
+    json.push_back(Json{"hello"});
+    json.back().name = "pushed";
+    ASSERT_EQ(json["pushed"].string(), "hello");
+
+    // Duplicate keys returns the first one like a linear search
+    json.push_back(Json{"second"});
+    json.back().name = "pushed";
+    ASSERT_EQ(json["pushed"].string(), "hello");
+
+    const auto copy = json;
+    ASSERT_EQ(copy["key999"].asInt64(), 999);
+    ASSERT(copy.find("key500") == copy.end(), "removed");
+
+    json.vector().insert(json.begin(), Json{"first"});
+    json.front().name = "inserted";
+    ASSERT_EQ(json["inserted"].string(), "first");
+    ASSERT_EQ(json["key0"].asInt64(), 0);
+
+    // Children reordered or renamed through the vector are still found
+    auto reordered = Json{};
+    for (int i = 0; i < 20; ++i) {
+        reordered["k" + std::to_string(i)].number(i);
+    }
+    ASSERT_EQ(reordered["k0"].asInt64(), 0);
+    std::reverse(reordered.begin(), reordered.end());
+    ASSERT(reordered.find("k0") != reordered.end(), "reordered");
+    ASSERT_EQ(reordered["k0"].asInt64(), 0);
+    ASSERT_EQ(reordered.size(), 20u);
+
+    reordered[3].name = "renamed";
+    ASSERT_EQ(reordered["renamed"].asInt64(), 16);
+    ASSERT(reordered.find("k16") == reordered.end(), "renamed");
+
+    const auto &shared = reordered;
+    ASSERT_EQ(shared["k1"].asInt64(), 1);
+    std::reverse(reordered.begin(), reordered.end());
+    ASSERT_EQ(shared["k1"].asInt64(), 1);
+    ASSERT_EQ(shared["k19"].asInt64(), 19);
+    ASSERT_EQ(reordered.size(), 20u);
+}
+
+TEST_CASE("lookup in very large objects") {
+    // Adding keys to a large object does not search all children, which
+    // would take seconds instead of milliseconds
+    auto start = std::chrono::steady_clock::now();
+    auto json = Json{};
+    for (int i = 0; i < 50000; ++i) {
+        json["key" + std::to_string(i)].number(i);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    ASSERT_EQ(json.size(), 50000u);
+    ASSERT_EQ(json["key49999"].asInt64(), 49999);
+    ASSERT(elapsed < std::chrono::seconds{2}, "expected linear time");
+}
+
+TEST_CASE("key literals") {
+    constexpr auto key = "key500"_jk;
+    static_assert(key.hash == Json::hashKey("key500"));
+    static_assert(key.name.size() == 6);
+
+    auto small = Json::Parse(R"({"a": 1, "key500": 2})");
+    ASSERT_EQ(small[key].asInt64(), 2);
+    ASSERT_EQ(small["a"_jk].asInt64(), 1);
+    ASSERT(small.find("missing"_jk) == small.end(), "");
+    ASSERT(!small.tryGet("missing"_jk), "");
+
+    auto large = Json{};
+    for (int i = 0; i < 1000; ++i) {
+        large["key" + std::to_string(i)].number(i);
+    }
+    ASSERT_EQ(large[key].asInt64(), 500);
+    ASSERT_EQ(large.tryGet(key), &large["key500"]);
+
+    // Missing keys are created like with a string
+    large["new"_jk].string("value");
+    ASSERT_EQ(large.size(), 1001);
+    ASSERT_EQ(large["new"].string(), "value");
+
+    const auto &constant = large;
+    ASSERT_EQ(constant["key999"_jk].asInt64(), 999);
+    bool thrown = false;
+    try {
+        constant["missing"_jk];
+    }
+    catch (std::out_of_range &) {
+        thrown = true;
+    }
+    ASSERT(thrown, "expected out_of_range");
+
+    // Adding and missing keys only hash once and do not search all children
+    auto names = std::vector<std::string>{};
+    auto missingNames = std::vector<std::string>{};
+    for (int i = 0; i < 50000; ++i) {
+        names.push_back("key" + std::to_string(i));
+        missingNames.push_back("missing" + std::to_string(i));
+    }
+    auto keys = std::vector<Json::Key>(names.begin(), names.end());
+    auto missing =
+        std::vector<Json::Key>(missingNames.begin(), missingNames.end());
+
+    auto start = std::chrono::steady_clock::now();
+    auto wide = Json{};
+    for (auto &key : keys) {
+        wide[key].number(1);
+    }
+    const auto &constWide = wide;
+    size_t found = 0;
+    for (auto &key : missing) {
+        found += wide.tryGet(key) != nullptr;
+        found += constWide.tryGet(key) != nullptr;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    ASSERT_EQ(wide.size(), 50000u);
+    ASSERT_EQ(found, 0u);
+    ASSERT(elapsed < std::chrono::seconds{2}, "expected linear time");
+}
+
+TEST_CASE("document") {
+    auto testJson = R"_(
+{
+   "test": "hello",
+   "escaped": "a\"b",
+   "sub": {
+       "array": [1, 2.5, [], {}, null, true, false],
+       "value": 10
+   },
+   "empty": {}
+}
+    )_"s;
+
+    auto doc = Json::Document::Parse(testJson);
+    auto json = Json::Parse(testJson);
+
+    ASSERT_EQ(doc.type(), Json::Object);
+    ASSERT_EQ(doc.size(), 4);
+    ASSERT_EQ(doc["test"].string(), "hello");
+    ASSERT_EQ(doc["escaped"].string(), "a\"b");
+    ASSERT_EQ(doc["sub"]["value"].asInt64(), 10);
+    ASSERT_EQ(doc["sub"]["array"].size(), 7);
+    ASSERT_EQ(doc["sub"]["array"][1].asDouble(), 2.5);
+    ASSERT_EQ(doc["sub"]["array"][5].boolean(), true);
+    ASSERT_EQ(doc["empty"].size(), 0);
+    ASSERT(doc["sub"].find("missing") == doc["sub"].end(), "");
+
+    auto names = std::string{};
+    for (auto child : doc) {
+        names += child.name();
+    }
+    ASSERT_EQ(names, "testescapedsubempty");
+
+    ASSERT_EQ(doc.stringify(), json.stringify());
+    ASSERT_EQ(doc.toJson().stringify(), json.stringify());
+
+    bool thrown = false;
+    try {
+        Json::Document::Parse("{\"a\": [1, 2}");
+    }
+    catch (Json::ParsingError &) {
+        thrown = true;
+    }
+    ASSERT(thrown, "expected parsing error");
+
+    ASSERT_EQ(Json::Document::Parse("").type(), Json::None);
+    auto stringDoc = Json::Document::Parse("\"str\"");
+    ASSERT_EQ(stringDoc.root().string(), "str");
+}
+
+TEST_CASE("nesting depth") {
+    auto depth = 5000;
+    auto deep = std::string(depth, '[') + "1" + std::string(depth, ']');
+
+    bool thrown = false;
+    try {
+        Json::Parse(deep);
+    }
+    catch (Json::ParsingError &e) {
+        thrown = true;
+        ASSERT_EQ(std::string{e.what()}.find("maximum depth"), 0);
+    }
+    ASSERT(thrown, "expected maximum depth to be exceeded");
+
+    auto options = Json::ParseOptions{};
+    options.maxDepth = depth;
+    auto json = Json::Parse(deep, options);
+    auto inner = &json;
+    for (int i = 0; i < depth; ++i) {
+        ASSERT_EQ(inner->type, Json::Array);
+        inner = &inner->front();
+    }
+    ASSERT_EQ(inner->asInt64(), 1);
+    ASSERT_EQ(Json::Document::Parse(deep, options).size(), 1);
+
+    // Parsing replaces the old content
+    json.parse("{\"a\": [1, {\"b\": 2}]}");
+    ASSERT_EQ(json.size(), 1);
+    ASSERT_EQ(json["a"][1]["b"].asInt64(), 2);
+
+    for (auto broken : {"[1,", "{\"a\" 1}", "[1 2]", "{\"a\": 1,}", "[}"}) {
+        thrown = false;
+        try {
+            Json::Parse(broken);
+        }
+        catch (Json::ParsingError &) {
+            thrown = true;
+        }
+        ASSERT(thrown, broken);
+    }
+}
+
+TEST_CASE("event parsing") {
+    struct Handler : public Json::EventHandler {
+        std::string events;
+        double sum = 0;
+
+        bool onNumber(Json::NumberValue value) {
+            sum += value.as<double>();
+            events += "n";
+            return true;
+        }
+        bool onString(std::string_view value) {
+            events += "s(" + std::string{value} + ")";
+            return true;
+        }
+        bool onKey(std::string_view name) {
+            events += "k(" + std::string{name} + ")";
+            return name != "stop";
+        }
+        bool onBeginObject() {
+            events += "{";
+            return true;
+        }
+        bool onEndObject() {
+            events += "}";
+            return true;
+        }
+        bool onBeginArray() {
+            events += "[";
+            return true;
+        }
+        bool onEndArray() {
+            events += "]";
+            return true;
+        }
+    };
+
+    auto text = R"({"a": [1, 2.5, "x\ty"], "b": {}, "stop": 3, "c": 4})";
+
+    auto handler = Handler{};
+    ASSERT_EQ(Json::ParseEvents(text, handler), false);
+    ASSERT_EQ(handler.events, "{k(a)[nns(x\ty)]k(b){}k(stop)");
+    ASSERT_EQ(handler.sum, 3.5);
+
+    auto ss = std::istringstream{"[1, 2, [3]]"};
+    auto streamHandler = Handler{};
+    ASSERT_EQ(Json::ParseEvents(ss, streamHandler), true);
+    ASSERT_EQ(streamHandler.events, "[nn[n]]");
+    ASSERT_EQ(streamHandler.sum, 6);
+}
+
+TEST_CASE("lazy parsing") {
+    auto text = std::string{R"({
+  "skipped": {"a": [1, {"b": "]}"}], "c": "\"{"},
+  "sub": {"array": [1, 2.5, "x\ty"], "value": 10},
+  "na\nme": true,
+  "broken": [1 2]
+})"};
+
+    auto doc = Json::ParseLazy(text);
+    ASSERT_EQ(doc.type(), Json::Object);
+    ASSERT_EQ(doc["sub"]["value"].asInt64(), 10);
+    ASSERT_EQ(doc["sub"]["array"].size(), 3);
+    ASSERT_EQ(doc["sub"]["array"][1].asDouble(), 2.5);
+    ASSERT_EQ(doc["sub"]["array"][2].string(), "x\ty");
+    ASSERT_EQ(doc["na\nme"].boolean(), true);
+    ASSERT_EQ(doc["skipped"]["c"].string(), "\"{");
+    ASSERT_EQ(doc["skipped"].raw(), R"({"a": [1, {"b": "]}"}], "c": "\"{"})");
+    ASSERT_EQ(doc["sub"]["value"].line(), 3);
+    ASSERT(doc.find("missing") == doc.end(), "");
+
+    auto names = std::string{};
+    for (auto &child : doc) {
+        names += child.name() + ",";
+    }
+    ASSERT_EQ(names, "skipped,sub,na\nme,broken,");
+
+    auto sub = doc["sub"].toJson();
+    ASSERT_EQ(sub.name, "sub");
+    ASSERT_EQ(sub["array"][2].string(), "x\ty");
+    ASSERT_EQ(sub.line(), 3);
+    ASSERT_EQ(Json::ParseLazy("[]").empty(), true);
+
+    // Siblings have the same depth
+    auto shallow = Json::ParseOptions{};
+    shallow.maxDepth = 2;
+    ASSERT_EQ(Json::ParseLazy("[[1], [2], [3], [4]]", shallow).size(), 4);
+    ASSERT_EQ(Json::ParseLazy("[[1], [2], [3], [4]]", shallow)[3][0].asInt64(),
+              4);
+    ASSERT_EQ(Json::ParseLazy("").type(), Json::None);
+
+    // Errors are the same as for the eager parser
+    auto message = [](auto f) {
+        try {
+            f();
+        }
+        catch (Json::ParsingError &e) {
+            return std::string{e.what()};
+        }
+        return std::string{};
+    };
+
+    auto eager = message([&] { Json::Parse(text); });
+    ASSERT_NE(eager, "");
+    ASSERT_EQ(message([&] { doc["broken"][1]; }), eager);
+
+    for (auto broken : {R"({"a": 1, "b" 2})",
+                        R"({"a": [1, 2, ]})",
+                        R"({"a": [1, 2})",
+                        R"({"a": {"x": "\q"}, "b": 1})",
+                        R"({"a": [[1], 2}, "b": 1})"}) {
+        // Visit all values so that all parts are scanned
+        std::function<void(const Json::Lazy &)> visit =
+            [&](const Json::Lazy &lazy) {
+                for (auto &child : lazy) {
+                    visit(child);
+                }
+            };
+        auto lazyMessage = message([&] { visit(Json::ParseLazy(broken)); });
+        ASSERT_EQ(lazyMessage, message([&] { Json::Parse(broken); }));
+    }
+
+    // Escaped slashes are skipped like the eager parser
+    auto slash = std::string{R"({"a": {"x": "\/"}, "b": 1})"};
+    ASSERT_EQ(Json::Parse(slash)["b"].asInt64(), 1);
+    ASSERT_EQ(Json::ParseLazy(slash)["b"].asInt64(), 1);
+    ASSERT_EQ(Json::ParseLazy(slash)["a"]["x"].string(), "/");
+    ASSERT_EQ(Json::Path{"/b"}.scan(slash).asInt64(), 1);
+}
+
+TEST_CASE("json lines") {
+    auto values = std::vector<Json>{};
+    for (int i = 0; i < 1000; ++i) {
+        auto &json = values.emplace_back(Json::Object);
+        json["id"].number(i);
+        json["text"] = "line\n" + std::to_string(i);
+        json["list"].vector({"a", "b"});
+    }
+
+    auto ss = std::stringstream{};
+    Json::WriteLines(ss, values, 3);
+    auto text = ss.str();
+    ASSERT_EQ(std::count(text.begin(), text.end(), '\n'), 1000);
+
+    auto options = Json::LineReader::Options{};
+    options.threads = 3;
+    options.blockSize = 100;
+    auto reader = Json::LineReader{ss, options};
+    int expected = 0;
+    for (auto &json : reader) {
+        ASSERT_EQ(json["id"].asInt64(), expected);
+        ASSERT_EQ(json["text"].string(), "line\n" + std::to_string(expected));
+        ++expected;
+    }
+    ASSERT_EQ(expected, 1000);
+
+    options.ordered = false;
+    auto unordered = std::istringstream{text};
+    int64_t sum = 0;
+    auto count = Json::LineReader{unordered, options}.forEach(
+        [&sum](Json &json) { sum += json["id"].asInt64(); });
+    ASSERT_EQ(count, 1000);
+    ASSERT_EQ(sum, 999 * 1000 / 2);
+
+    // Empty lines are skipped and errors have the line in the input
+    auto broken = std::istringstream{"1\n\n  \r\n2\n{\"a\": }\n3"};
+    auto brokenReader = Json::LineReader{broken, options};
+    auto json = Json{};
+    ASSERT_EQ(brokenReader.next(json), true);
+    ASSERT_EQ(json.asInt64(), 1);
+    ASSERT_EQ(brokenReader.next(json), true);
+    ASSERT_EQ(json.asInt64(), 2);
+    auto line = 0u;
+    try {
+        brokenReader.next(json);
+    }
+    catch (Json::ParsingError &e) {
+        line = e.position.line;
+    }
+    ASSERT_EQ(line, 5);
+}
+
+TEST_CASE("stringify") {
+    auto text = std::string{R"({"a": [1, 2.5, {"b": "x\ty"}], "c": {}, "d": [],)"
+                            R"( "e": null, "f": true})"};
+    auto json = Json::Parse(text);
+
+    ASSERT_EQ(json.stringify(Json::compact),
+              R"({"a":[1,2.5,{"b":"x\ty"}],"c":{},"d":[],"e":null,"f":true})");
+    ASSERT_EQ(json.stringify(2),
+              "{\n  \"a\": [\n    1,\n    2.5,\n    {\n      \"b\": "
+              "\"x\\ty\"\n    }\n  ],\n  \"c\": {},\n  \"d\": [],\n  "
+              "\"e\": null,\n  \"f\": true\n}");
+
+    for (auto indent : {Json::compact, 0, 2, 4}) {
+        auto expected = json.stringify(indent);
+        ASSERT_EQ(json.stringifiedSize(indent), expected.size());
+
+        auto ss = std::ostringstream{};
+        json.stringify(ss, indent);
+        ASSERT_EQ(ss.str(), expected);
+
+        auto document = Json::Document::Parse(text);
+        ASSERT_EQ(document.stringify(indent), expected);
+    }
+
+    // Output is appended and the capacity is kept
+    auto out = std::string{"x"};
+    json["a"].stringify(out, Json::compact);
+    ASSERT_EQ(out, R"(x[1,2.5,{"b":"x\ty"}])");
+    auto capacity = out.capacity();
+    out.clear();
+    json["a"].stringify(out, Json::compact);
+    ASSERT_EQ(out.capacity(), capacity);
+}
+
+TEST_CASE("parallel stringify") {
+    auto json = Json{Json::Object};
+    json["small"].vector({"a", "b"});
+    auto &large = json["large"];
+    large.type = Json::Array;
+    for (int i = 0; i < 1000; ++i) {
+        auto &item = large.emplace_back(Json::Object);
+        item["id"].number(i);
+        item["values"].vector({"x", std::to_string(i)});
+    }
+    json["empty"] = Json{Json::Array};
+
+    auto options = Json::StringifyOptions{};
+    options.threads = 3;
+    options.threshold = 100;
+    for (auto indent : {Json::compact, 0, 2}) {
+        ASSERT_EQ(json.stringify(indent, options), json.stringify(indent));
+    }
+
+    // Not split when below the threshold
+    ASSERT_EQ(Json::Parse("[1, [2]]").stringify(2, options),
+              Json::Parse("[1, [2]]").stringify(2));
+
+    json.saveFile("json_test_parallel.json", 4, options);
+    ASSERT_EQ(Json::readFile("json_test_parallel.json"), json.stringify());
+    std::remove("json_test_parallel.json");
+}
+
+TEST_CASE("typed parsing") {
+    auto text = std::string{R"({
+        "name": "origin\tpoint",
+        "ignored": {"a": [1, {"b": null}], "c": "}"},
+        "position": {"x": 1, "y": -2.5},
+        "tags": ["a", "b"],
+        "path": [{"x": 3, "y": 4}],
+        "visible": true,
+        "weight": null
+    })"};
+
+    auto shape = Json::ParseInto<testtypes::Shape>(text);
+    ASSERT_EQ(shape.name, "origin\tpoint");
+    ASSERT_EQ(shape.position.x, 1);
+    ASSERT_EQ(shape.position.y, -2.5);
+    ASSERT_EQ(shape.tags.size(), 2);
+    ASSERT_EQ(shape.tags.at(1), "b");
+    ASSERT_EQ(shape.path.size(), 1);
+    ASSERT_EQ(shape.path.front().y, 4);
+    ASSERT(shape.visible, "expected visible");
+    ASSERT(!shape.weight, "expected no weight");
+
+    auto ss = std::istringstream{text};
+    ASSERT_EQ(Json::ParseInto<testtypes::Shape>(ss).name, shape.name);
+
+    // Same result as the tree when written
+    shape.weight = 2;
+    auto serialized = Json::Serialize(shape);
+    ASSERT_EQ(serialized, Json::Parse(serialized).stringify());
+    ASSERT_EQ(Json::Serialize(testtypes::Point{1, 2}, Json::compact),
+              R"({"x":1,"y":2})");
+
+    shape.weight.reset();
+    auto written = Json::Parse(Json::Serialize(shape));
+    ASSERT(written.find("weight") == written.end(), "empty optional");
+    auto numbers = Json::ParseInto<std::vector<int>>("[1, 2, 3]");
+    ASSERT_EQ(numbers.back(), 3);
+
+    for (auto invalid : {R"({"x": "1"})", R"({"x": 1)", R"({"z": [}})"}) {
+        bool thrown = false;
+        try {
+            Json::ParseInto<testtypes::Point>(invalid);
+        }
+        catch (Json::ParsingError &) {
+            thrown = true;
+        }
+        ASSERT(thrown, std::string{"expected error for "} + invalid);
+    }
+
+    // Numbers are not truncated or wrapped to fit the field
+    auto unsignedValues = Json::ParseInto<std::vector<unsigned>>("[0, 4e9]");
+    ASSERT_EQ(unsignedValues.back(), 4000000000u);
+    auto doubles = Json::ParseInto<std::vector<double>>("[3.7]");
+    ASSERT_EQ(doubles.back(), 3.7);
+    for (auto invalid : {"[3.7]", "[1e10]", "[-1]"}) {
+        bool thrown = false;
+        try {
+            if (invalid == std::string{"[-1]"}) {
+                Json::ParseInto<std::vector<unsigned>>(invalid);
+            }
+            else {
+                Json::ParseInto<std::vector<int>>(invalid);
+            }
+        }
+        catch (Json::ParsingError &) {
+            thrown = true;
+        }
+        ASSERT(thrown, std::string{"expected error for "} + invalid);
+    }
+}
+
+TEST_CASE("paths") {
+    auto text = std::string{R"({
+        "payload": {"items": [{"price": 1}, {"price": 2.5}], "a/b": {"~": 3}},
+        "skipped": [{"price": 10}],
+        "escaped": true
+    })"};
+    auto json = Json::Parse(text);
+
+    auto price = Json::Path{"/payload/items/1/price"};
+    ASSERT_EQ(price.size(), 4);
+    ASSERT(price == Json::Path{"payload.items[1].price"}, "same path");
+    ASSERT(price == Json::Path{"payload.items.1.price"}, "same path");
+    ASSERT_EQ(price.get(json).asDouble(), 2.5);
+    ASSERT_EQ(price.scan(text).asDouble(), 2.5);
+
+    auto escaped = Json::Path{"/payload/a~1b/~0"};
+    ASSERT_EQ(escaped.pointer(), "/payload/a~1b/~0");
+    ASSERT_EQ(escaped.get(json).asInt64(), 3);
+    ASSERT_EQ(escaped.scan(text).asInt64(), 3);
+    ASSERT_EQ(Json::Path{"/escaped"}.scan(text).type(), Json::Boolean);
+    ASSERT_EQ(Json::Path{""}.find(json), &json);
+
+    for (auto missing : {"/payload/items/2", "/payload/items/01", "/x/y"}) {
+        ASSERT_EQ(Json::Path{missing}.find(json), nullptr);
+        ASSERT_EQ(Json::Path{missing}.scan(text).type(), Json::None);
+    }
+
+    // Missing values are empty and do not read past the end of the buffer
+    auto exact = std::vector<char>(text.begin(), text.end());
+    auto view = std::string_view{exact.data(), exact.size()};
+    ASSERT_EQ(Json::Path{"/missing"}.scan(view).raw(), "");
+
+    for (auto invalid : {"/a~2", "a..b", "a[x]", "a[1", "a."}) {
+        bool thrown = false;
+        try {
+            Json::Path{invalid};
+        }
+        catch (std::invalid_argument &) {
+            thrown = true;
+        }
+        ASSERT(thrown, std::string{"expected error for "} + invalid);
+    }
+
+    auto paths = Json::PathSet{{"/payload/items/1/price",
+                                "/payload/items/0",
+                                "/missing",
+                                "/payload/items/0/price",
+                                "/escaped"}};
+    ASSERT_EQ(paths.add("/payload/items/1/price"), 5);
+
+    auto values = paths.find(json);
+    ASSERT_EQ(values.size(), 6);
+    ASSERT_EQ(values.at(0)->asDouble(), 2.5);
+    ASSERT_EQ(values.at(1)->type, Json::Object);
+    ASSERT_EQ(values.at(2), nullptr);
+    ASSERT_EQ(values.at(3)->asInt64(), 1);
+    ASSERT_EQ(values.at(5), values.at(0));
+
+    auto scanned = paths.scan(text);
+    ASSERT_EQ(scanned.size(), 6);
+    ASSERT_EQ(scanned.at(0).asDouble(), 2.5);
+    ASSERT_EQ(scanned.at(1).raw(), R"({"price": 1})");
+    ASSERT_EQ(scanned.at(2).type(), Json::None);
+    ASSERT_EQ(scanned.at(2).raw(), "");
+    ASSERT_EQ(scanned.at(3).asInt64(), 1);
+    ASSERT_EQ(scanned.at(4).boolean(), true);
+    ASSERT_EQ(scanned.at(5).raw(), "2.5");
+
+    // Large objects use the hash index
+    auto large = Json{Json::Object};
+    for (int i = 0; i < 100; ++i) {
+        large["key" + std::to_string(i)].number(i);
+    }
+    ASSERT_EQ(Json::Path{"/key50"}.get(large).asInt64(), 50);
+}
+
+TEST_CASE("incremental parsing") {
+    auto text = std::string{"\xef\xbb\xbf"} + R"({
+        "name": "split \"escaped\" \\ string å",
+        "numbers": [1, -2.5e3, 12345678901234],
+        "nested": {"empty": {}, "list": [[], [true, false, null]]}
+    } )";
+    auto expected = Json::Parse(text);
+
+    // Every part size gives the same result
+    for (size_t size = 1; size <= text.size(); size *= 2) {
+        auto parser = Json::IncrementalParser{};
+        for (size_t i = 0; i < text.size(); i += size) {
+            auto part = std::string_view{text}.substr(i, size);
+            auto status = parser.feed(part);
+            ASSERT_EQ(status,
+                      i + size < text.size() - 1
+                          ? Json::IncrementalParser::NeedMore
+                          : Json::IncrementalParser::Complete);
+        }
+        auto json = parser.take();
+        ASSERT_EQ(json.stringify(), expected.stringify());
+        ASSERT_EQ(json["numbers"][1].pos.line, 3);
+    }
+
+    // A number at the root is not finished until the input ends
+    auto parser = Json::IncrementalParser{};
+    ASSERT_EQ(parser.feed("12"), Json::IncrementalParser::NeedMore);
+    ASSERT_EQ(parser.feed("3"), Json::IncrementalParser::NeedMore);
+    ASSERT_EQ(parser.finish(), Json::IncrementalParser::Complete);
+    ASSERT_EQ(parser.take().asInt64(), 123);
+
+    // The parser is reused after take()
+    ASSERT_EQ(parser.feed("[tr"), Json::IncrementalParser::NeedMore);
+    ASSERT_EQ(parser.feed("ue]"), Json::IncrementalParser::Complete);
+    ASSERT_EQ(parser.take()[0].stringify(), "true");
+
+    auto error = [](std::vector<std::string> parts, bool finish) {
+        auto parser = Json::IncrementalParser{};
+        for (auto &part : parts) {
+            parser.feed(part);
+        }
+        if (finish) {
+            parser.finish();
+        }
+        return parser.status() == Json::IncrementalParser::Error &&
+               parser.error();
+    };
+
+    ASSERT(error({"[1, ", "2 3]"}, false), "missing coma");
+    ASSERT(error({"{\"a\" ", "1}"}, false), "missing colon");
+    ASSERT(error({"[nul", "x]"}, false), "invalid word");
+    ASSERT(error({"[1] ", "2"}, true), "data after value");
+    ASSERT(error({"[\"unfinished"}, true), "unfinished string");
+    ASSERT(error({"{\"a\": ["}, true), "unfinished array");
+    ASSERT(!error({"[1]", " \n"}, true), "whitespace after value");
+
+    // Strict checks are the same as for Json::Parse
+    auto strict = Json::ParseOptions{};
+    strict.strict = true;
+    for (auto text : {"[1, 01]", "[\"tab\tin string\"]", "{\"\\u12\": 1}"}) {
+        auto checked = Json::IncrementalParser{strict};
+        for (auto c : std::string_view{text}) {
+            checked.feed(&c, 1);
+        }
+        checked.finish();
+        ASSERT_EQ(checked.status(), Json::IncrementalParser::Error);
+        try {
+            Json::Parse(text, strict);
+        }
+        catch (Json::ParsingError &e) {
+            ASSERT_EQ(checked.error()->info, e.info);
+        }
+
+        auto lenient = Json::IncrementalParser{};
+        lenient.feed(text);
+        ASSERT_EQ(lenient.finish(), Json::IncrementalParser::Complete);
+    }
+
+    auto deep = Json::ParseOptions{};
+    deep.maxDepth = 2;
+    auto limited = Json::IncrementalParser{deep};
+    ASSERT_EQ(limited.feed("[[["), Json::IncrementalParser::Error);
+    try {
+        Json::Parse("[[[", deep);
+    }
+    catch (Json::ParsingError &e) {
+        ASSERT_EQ(limited.error()->errorString, e.errorString);
+    }
+}
+
+TEST_CASE("shared values") {
+    auto json = Json{};
+    for (int i = 0; i < 100; ++i) {
+        json["key" + std::to_string(i)]["values"].vector({"a", "b"});
+    }
+
+    auto config = Json::Shared{std::move(json)};
+    auto copy = config;
+    ASSERT_EQ(&*copy, &*config);
+    ASSERT(!config.unique(), "shared");
+
+    // Children refers to the same memory
+    auto child = config.at("key50").at("values");
+    ASSERT_EQ(&*child, &config->operator[]("key50")["values"]);
+    ASSERT_EQ(child.at(1)->string(), "b");
+
+    // Changes are made on a copy and are not seen by others
+    copy.edit()["key50"]["values"].vector({"c"});
+    ASSERT_NE(&*copy, &*config);
+    ASSERT_EQ(copy.at("key50").at("values")->size(), 1);
+    ASSERT_EQ(child->size(), 2);
+    ASSERT_EQ(config->size(), 100);
+
+    // A unique value is changed in place
+    ASSERT(copy.unique(), "no other instance");
+    auto before = &*copy;
+    copy.edit().remove("key0");
+    ASSERT_EQ(&*copy, before);
+    ASSERT_EQ(copy->size(), 99);
+
+    auto empty = Json::Shared{};
+    ASSERT_EQ(empty->type, Json::None);
+    empty.edit()["a"].string("b");
+    ASSERT_EQ(empty->size(), 1);
+
+    // Reading from many threads, the key index is built by the first lookup
+    auto threads = std::vector<std::thread>{};
+    auto found = std::atomic<int>{0};
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([shared = config, &found] {
+            for (int i = 0; i < 100; ++i) {
+                auto key = "key" + std::to_string(i);
+                found += shared->find(key) != shared->end();
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    ASSERT_EQ(found, 400);
+}
+
+TEST_CASE("binary") {
+    auto json = Json::Parse(R"({
+        "text": "hello å",
+        "numbers": [0, 23, 24, 255, 256, 65536, -1, -1000, 4294967296,
+                    18446744073709551615, -9223372036854775808, 1.5, 0.1,
+                    1e300],
+        "empty": {"array": [], "object": {}, "string": ""},
+        "values": [true, false, null]
+    })");
+
+    auto data = json.binary();
+    ASSERT_LT(data.size(), json.stringify(Json::compact).size());
+    auto copy = Json::ParseBinary(data);
+    ASSERT_EQ(copy.stringify(), json.stringify());
+    ASSERT_EQ(copy["numbers"][9].asUInt64(), 18446744073709551615u);
+    ASSERT_EQ(copy["numbers"][10].asInt64(), INT64_MIN);
+
+    auto stream = std::stringstream{};
+    json.writeBinary(stream);
+    ASSERT_EQ(stream.str(), data);
+    ASSERT_EQ(Json::ParseBinary(stream).stringify(), json.stringify());
+
+    // Examples from RFC 8949 appendix A
+    ASSERT_EQ(Json{100}.binary(), "\x18\x64");
+    ASSERT_EQ(Json{-1000}.binary(), "\x39\x03\xe7");
+    ASSERT_EQ(Json::Parse("[1, [2, 3]]").binary(), "\x82\x01\x82\x02\x03");
+    ASSERT_EQ(Json::ParseBinary("\xf9\x3c\x00"sv).asDouble(), 1.);
+    ASSERT_EQ(Json::ParseBinary("\xf9\xc4\x00"sv).asDouble(), -4.);
+    ASSERT_EQ(Json::ParseBinary("\xfa\x47\xc3\x50\x00"sv).asDouble(), 100000.);
+    ASSERT_EQ(Json::ParseBinary("\xc1\x1a\x51\x4b\x67\xb0"sv).asInt64(),
+              1363896240); // Tagged date
+
+    // Many tags before a value do not use the stack
+    auto tagged = std::string(2000000, '\xc0') + "\x01";
+    ASSERT_EQ(Json::ParseBinary(tagged).asInt64(), 1);
+    ASSERT_EQ(
+        Json::ParseBinary("\xbf\x61\x61\x01\x61\x62\x9f\x02\x03\xff\xff"sv)
+            .stringify(Json::compact),
+        R"({"a":1,"b":[2,3]})");
+    ASSERT_EQ(Json::ParseBinary("\x7f\x65strea\x64ming\xff"sv).string(),
+              "streaming");
+
+    const auto fname = "binary_test.cbor";
+    json.saveBinary(fname);
+    ASSERT_EQ(Json::LoadBinary(fname).stringify(), json.stringify());
+    std::remove(fname);
+
+    for (auto invalid : {"\x82\x01"sv,
+                         "\x7a\xff\xff\xff\xff"sv,
+                         "\x42"
+                         "ab"sv,
+                         "\xa1\x01\x02"sv,
+                         "\x1c"sv}) {
+        bool thrown = false;
+        try {
+            Json::ParseBinary(invalid);
+        }
+        catch (Json::ParsingError &) {
+            thrown = true;
+        }
+        ASSERT(thrown, "expected error for malformed input");
+    }
+}
+
+TEST_CASE("validate") {
+    auto valid = {
+        R"({"a": [1, -0, 0.5, 1e5, -1.5E-3, true, false, null]})",
+        R"("escaped \"\\\/\b\f\n\r\t å")",
+        " 12 ",
+        "[]",
+    };
+    for (auto text : valid) {
+        auto error = Json::Validate(text);
+        ASSERT(!error, std::string{text} + " " + (error ? error->what() : ""));
+        auto stream = std::istringstream{text};
+        ASSERT(!Json::Validate(stream), text);
+    }
+    ASSERT_EQ(Json::Parse(R"("a\/b")").string(), "a/b");
+
+    auto invalid = {
+        "",
+        "01",
+        "[.5]",
+        "[1.]",
+        "[-]",
+        "[1e]",
+        "[+1]",
+        "\"tab\tin string\"",
+        R"("\u12")",
+        R"("\u12x4")",
+        "[1] 2",
+        "{} {}",
+        R"({"a": 1,})",
+        "[nul]",
+    };
+    for (auto text : invalid) {
+        ASSERT(Json::Validate(text), text);
+        auto stream = std::istringstream{text};
+        ASSERT(Json::Validate(stream), text);
+    }
+
+    auto error = Json::Validate("{\n  \"a\": 01\n}");
+    ASSERT(error, "expected error");
+    ASSERT_EQ(error->position.line, 2u);
+    auto stream = std::istringstream{"{\n  \"a\": 01\n}"};
+    auto streamError = Json::Validate(stream);
+    ASSERT(streamError, "expected error");
+    ASSERT_EQ(streamError->errorString, error->errorString);
+    ASSERT_EQ(error->info, "invalid number: 01");
+
+    // Parse is only strict when asked to
+    auto options = Json::ParseOptions{};
+    ASSERT_EQ(Json::Parse("[01]").front().asInt64(), 1);
+    options.strict = true;
+    bool thrown = false;
+    try {
+        Json::Parse("[01]", options);
+    }
+    catch (Json::ParsingError &) {
+        thrown = true;
+    }
+    ASSERT(thrown, "expected strict parse to throw");
+}
+
+TEST_CASE("parse without positions") {
+    auto options = Json::ParseOptions{};
+    options.positions = false;
+
+    auto json = Json::Parse("{\n  \"a\": [1,\n  2]\n}", options);
+    ASSERT_EQ(json["a"][1].asInt64(), 2);
+    ASSERT_EQ(json["a"][1].line(), 1u);
+
+    // Errors are located the same way as when positions are counted
+    auto invalid = {
+        "{\n  \"a\": [1,\n  2 3]\n}",
+        "\xef\xbb\xbf[1,\n tru]",
+        "[\n\"unterminated",
+        "{\"a\"\n\n  1}",
+        "[1]\n  x",
+    };
+    for (auto text : invalid) {
+        auto position = [&](Json::ParseOptions options) {
+            options.strict = true;
+            try {
+                Json::Parse(text, options);
+            }
+            catch (Json::ParsingError &e) {
+                return e.position;
+            }
+            return Json::Position{0, 0};
+        };
+        auto expected = position({});
+        auto actual = position(options);
+        ASSERT_NE(expected.line, 0u);
+        ASSERT_EQ(actual.line, expected.line);
+        ASSERT_EQ(actual.col, expected.col);
+    }
+
+    auto error = Json::Validate("[\n1,\n01]");
+    ASSERT(error, "expected error");
+    ASSERT_EQ(error->position.line, 3u);
+    ASSERT_EQ(error->position.col, 3u);
+}
+
+TEST_CASE("lookup and parse without exceptions") {
+    auto json = Json{};
+    auto error = json.tryParse(R"({"a": 1.5, "b": "text", "c": [true]})");
+    ASSERT(!error, "expected no error");
+
+    ASSERT(json.tryGet("a"), "expected a");
+    ASSERT(!json.tryGet("missing"), "expected nothing");
+    auto flag = json.tryGet("c")->tryGet(0)->getIf<bool>();
+    ASSERT(flag && *flag, "expected true");
+    ASSERT(!json.tryGet("c")->tryGet(1), "expected nothing");
+    ASSERT(!json.tryGet("c")->tryGet(-1), "expected nothing");
+
+    auto number = json["a"].getIf<double>();
+    ASSERT(number, "expected number");
+    ASSERT_EQ(*number, 1.5);
+    ASSERT(!json["a"].getIf<int>(), "expected nothing for fraction");
+    auto numbers = Json::Parse("[2.0, 1e10, -1, 1e300]");
+    auto integer = numbers[0].getIf<int>();
+    ASSERT(integer, "expected number");
+    ASSERT_EQ(*integer, 2);
+    auto large = numbers[1].getIf<int64_t>();
+    ASSERT(large, "expected number");
+    ASSERT_EQ(*large, 10000000000);
+    ASSERT(!numbers[1].getIf<int>(), "expected nothing when out of range");
+    ASSERT(!numbers[2].getIf<unsigned>(), "expected nothing when negative");
+    ASSERT(!numbers[3].getIf<int64_t>(), "expected nothing when too large");
+    ASSERT(!json["a"].getIf<std::string>(), "expected nothing");
+    auto string = json["b"].getIf<std::string_view>();
+    ASSERT(string, "expected string");
+    ASSERT_EQ(*string, "text");
+    ASSERT(!json["b"].getIf<double>(), "expected nothing");
+    ASSERT(!json["b"].getIf<bool>(), "expected nothing");
+
+    // Missing keys in large objects only use the key index without
+    // searching all children or rebuilding the index
+    auto wide = Json{};
+    for (int i = 0; i < 50000; ++i) {
+        wide["key" + std::to_string(i)].number(i);
+    }
+    const auto &constWide = wide;
+    auto start = std::chrono::steady_clock::now();
+    size_t found = 0;
+    for (int i = 0; i < 50000; ++i) {
+        auto name = "missing" + std::to_string(i);
+        found += wide.tryGet(name) != nullptr;
+        found += constWide.tryGet(name) != nullptr;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    ASSERT_EQ(found, 0u);
+    ASSERT(elapsed < std::chrono::seconds{2}, "expected constant time misses");
+
+    // Errors are the same as the ones that are thrown
+    auto invalid = {
+        "{\"a\": [1,\n 2 3]}",
+        "[tru]",
+        "{\"a\" 1}",
+        "[1, 2",
+        "\"unterminated",
+    };
+    for (auto text : invalid) {
+        auto returned = json.tryParse(text);
+        ASSERT(returned, text);
+        bool thrown = false;
+        try {
+            Json::Parse(text);
+        }
+        catch (Json::ParsingError &e) {
+            thrown = true;
+            ASSERT_EQ(returned->errorString, e.errorString);
+        }
+        ASSERT(thrown, text);
+    }
+
+    auto options = Json::ParseOptions{};
+    options.strict = true;
+    error = json.tryParse("[1] 2", options);
+    ASSERT(error, "expected error");
+    ASSERT_EQ(error->info, "unexpected data after value");
+}
+
+TEST_CASE("equality and hash") {
+    auto a = Json::Parse(R"({"a": [1, 2.5, "x"], "b": {"c": null, "d": true}})");
+    auto reordered = Json::Parse(R"({"b": {"d": true, "c": null}, "a": [1, 2.5, "x"]})");
+    ASSERT(a == reordered, "member order does not matter");
+    ASSERT_EQ(a.hash(), reordered.hash());
+
+    auto changed = Json::Parse(R"({"a": [1, 2.5, "y"], "b": {"c": null, "d": true}})");
+    ASSERT(a != changed, "");
+    ASSERT_NE(a.hash(), changed.hash());
+    ASSERT(Json::Parse("[1, 2]") != Json::Parse("[2, 1]"), "array order");
+    ASSERT(Json::Parse("[1]") != Json::Parse("[1, 1]"), "");
+    ASSERT(Json::Parse(R"({"a": 1})") != Json::Parse(R"({"b": 1})"), "");
+
+    // Numbers are compared by value
+    ASSERT(Json::Parse("1") == Json::Parse("1.0"), "");
+    ASSERT_EQ(Json::Parse("1").hash(), Json::Parse("1.0").hash());
+    ASSERT(Json::Parse("1") != Json::Parse("1.5"), "");
+    ASSERT(Json::Parse("1") != Json::Parse("\"1\""), "");
+    ASSERT(Json::Parse("18446744073709551615") ==
+               Json{}.number(uint64_t{18446744073709551615u}),
+           "");
+
+    auto set = std::unordered_set<Json>{};
+    set.insert(a);
+    set.insert(reordered);
+    set.insert(changed);
+    ASSERT_EQ(set.size(), 2u);
+}
+
+TEST_CASE("diff") {
+    // Applies the operations that Diff creates
+    auto apply = [](Json json, const Json &patch) {
+        for (auto &operation : patch) {
+            auto op = operation["op"].string();
+            auto pointer = operation["path"].string();
+            if (pointer.empty()) {
+                json = operation["value"];
+                continue;
+            }
+            auto split = pointer.rfind('/');
+            auto &parent = *Json::Path{pointer.substr(0, split)}.find(json);
+            auto name = Json::Path{pointer.substr(split)}.segments()[0].name;
+            if (parent.type == Json::Array) {
+                auto it = parent.begin() + std::stol(name);
+                if (op == "remove") {
+                    parent.vector().erase(it);
+                }
+                else if (op == "add") {
+                    parent.vector().insert(it, operation["value"]);
+                }
+                else {
+                    *it = operation["value"];
+                }
+            }
+            else if (op == "remove") {
+                parent.remove(name);
+            }
+            else {
+                auto &child = parent[name];
+                child = operation["value"];
+                child.name = name;
+            }
+        }
+        return json;
+    };
+
+    auto from = Json::Parse(R"({"a": 1, "b": [1, 2, 3], "c/d": {"e": "x"}})");
+    auto to = Json::Parse(R"({"a": 2, "b": [1, 3], "c/d": {"e": "x"}, "f": 1})");
+    auto patch = Json::Diff(from, to);
+    ASSERT_EQ(patch.stringify(Json::compact),
+              R"([{"op":"replace","path":"/a","value":2},)"
+              R"({"op":"remove","path":"/b/1"},)"
+              R"({"op":"add","path":"/f","value":1}])");
+    ASSERT(apply(from, patch) == to, "");
+    ASSERT_EQ(Json::Diff(to, to).size(), 0u);
+
+    patch = Json::Diff(from, Json::Parse(R"({"c/d": {"e": "y"}})"));
+    ASSERT_EQ(patch.back()["path"].string(), "/c~1d/e");
+    ASSERT_EQ(Json::Diff(from, Json::Parse("[]")).front()["path"].string(),
+              "");
+
+    // Few changes in a large document gives a small patch
+    auto large = Json{Json::Array};
+    for (int i = 0; i < 1000; ++i) {
+        large.push_back(Json::Parse(R"({"id": 0, "tags": ["a", "b"]})"));
+        large.back()["id"].number(i);
+    }
+    auto modified = large;
+    modified[10]["id"].number(-1);
+    modified[20]["tags"].push_back(Json{"c"});
+    modified[30].remove("tags");
+    modified.vector().insert(modified.begin() + 500, Json{"inserted"});
+    modified.vector().erase(modified.begin() + 900);
+    patch = Json::Diff(large, modified);
+    ASSERT_LT(patch.size(), 10u);
+    ASSERT(apply(large, patch) == modified, patch.stringify());
+
+    // Subtrees with the same hash are not compared further. Members with
+    // the same name in another order have the same hash but are not equal
+    auto duplicates = Json::Parse(R"({"x": {"a": 1, "a": 2}})");
+    auto swapped = Json::Parse(R"({"x": {"a": 2, "a": 1}})");
+    ASSERT(duplicates != swapped, "");
+    ASSERT_EQ(duplicates.hash(), swapped.hash());
+    ASSERT_EQ(Json::Diff(duplicates, swapped).size(), 0u);
+}
+
+#ifdef JSON_PARSE_STATS
+
+TEST_CASE("parse stats") {
+    auto text = std::string{R"({"a": [1, 2.5, "x\ty"], "long name that allocates": {}})"};
+
+    auto stats = Json::ParseStats{};
+    auto options = Json::ParseOptions{};
+    options.stats = &stats;
+    auto json = Json::Parse(text, options);
+
+    ASSERT_EQ(stats.bytes, text.size());
+    ASSERT_EQ(stats.nodeCount(), 6);
+    ASSERT_EQ(stats.nodes[Json::Object], 2);
+    ASSERT_EQ(stats.nodes[Json::Number], 2);
+    ASSERT_EQ(stats.nodes[Json::String], 1);
+    ASSERT_EQ(stats.maxDepth, 2);
+    ASSERT_EQ(stats.numberBytes, 4);
+    ASSERT_EQ(stats.escapedStrings, 1);
+    ASSERT_EQ(stats.stringBytes, 1 + 4 + 24);
+    ASSERT_GT(stats.allocations, 0);
+
+    // Counters are for the last parse only
+    auto ss = std::istringstream{"[null, true]"};
+    json.parse(ss, options);
+    ASSERT_EQ(stats.nodeCount(), 3);
+    ASSERT_EQ(stats.maxDepth, 1);
+}
+
+#endif
+
 TEST_SUIT_END;
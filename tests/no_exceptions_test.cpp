@@ -0,0 +1,44 @@
+// Built with -fno-exceptions to check that the header compiles without
+// exceptions and that the functions that returns errors work
+
+#include "json/json.h"
+#include <iostream>
+
+namespace {
+
+int failed = 0;
+
+void check(bool condition, const char *description) {
+    if (!condition) {
+        std::cout << "FAIL " << description << "\n";
+        ++failed;
+    }
+}
+
+} // namespace
+
+int main(int, char *[]) {
+    auto json = Json{};
+    auto error = json.tryParse(R"({"a": [1, 2], "b": "text"})");
+    check(!error, "parse valid json");
+    check(json.tryGet("a") && json.tryGet("a")->tryGet(1), "find child");
+    check(!json.tryGet("c"), "missing child");
+    check(json["b"].getIf<std::string>() == "text", "get string");
+    check(!json["b"].getIf<double>(), "type mismatch");
+
+    error = json.tryParse("{\n  \"a\": [1 2]\n}");
+    check(error && error->position.line == 2, "error position");
+
+    auto options = Json::ParseOptions{};
+    options.positions = false;
+    auto uncounted = json.tryParse("{\n  \"a\": [1 2]\n}", options);
+    check(uncounted && uncounted->errorString == error->errorString,
+          "error position without counting positions");
+
+    check(Json::Validate("[01]").has_value(), "validate");
+    auto stream = std::istringstream{"[01]"};
+    check(Json::Validate(stream).has_value(), "validate stream");
+
+    std::cout << (failed ? "failed" : "ok") << "\n";
+    return failed ? 1 : 0;
+}